@@ -0,0 +1,43 @@
+
+# builds the fixed point sim with gcc and clang at -O0 and -O3, plays the same
+# seeded game headless in each (--sim-hash), and fails if any two disagree.
+# TICKS, SEED and LEVEL override the defaults.
+
+if [ ! -d "dist" ]; then
+    echo "[Hash]: Making dist directory."
+    mkdir dist
+fi
+
+FILE='src/main.cpp'
+TICKS=${TICKS:-20000}
+SEED=${SEED:-1}
+LEVEL=${LEVEL:-gen:256}
+FLAGS='-DSIM_FIXED_POINT -ffp-contract=off -fno-fast-math'
+LIBS='-lm -lpthread -lGL -lGLEW -lglfw -lraylib'
+
+FIRST=''
+STATUS=0
+for CXX in g++ clang++; do
+    for OPT in -O0 -O3; do
+        NAME="dist/sim_hash_${CXX}${OPT}"
+        echo "[Hash]: Building $NAME."
+        if ! $CXX $OPT $FLAGS -o $NAME $FILE $LIBS; then
+            echo "[Hash]: ERROR - $CXX $OPT did not build."
+            exit 1
+        fi
+
+        ./$NAME --sim-hash $TICKS --seed $SEED --level $LEVEL > $NAME.txt
+        if [ -z "$FIRST" ]; then
+            FIRST=$NAME.txt
+        elif ! cmp -s $FIRST $NAME.txt; then
+            echo "[Hash]: MISMATCH - $NAME.txt differs from $FIRST:"
+            diff $FIRST $NAME.txt | head -n 4
+            STATUS=1
+        fi
+    done
+done
+
+if [ $STATUS -eq 0 ]; then
+    echo "[Hash]: all builds agree: $(tail -n 1 $FIRST)"
+fi
+exit $STATUS
@@ -5,188 +5,3177 @@
 #include <raylib.h>
 #include <raymath.h>
 
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <float.h>
+#include <time.h>
+
 #define WINDOW_WIDTH  1200
 #define WINDOW_HEIGHT  900 
 
-#define MAP_SIZE  700
-#define TILE_SIZE (MAP_SIZE / 28.0f)
-#define HALF_TILE (TILE_SIZE * 0.5f)
+#define MAP_SIZE  700
+#define TILE_SIZE (MAP_SIZE / 28.0f)
+#define HALF_TILE (TILE_SIZE * 0.5f)
+
+const float MAP_X_BEGIN  = ((WINDOW_WIDTH - MAP_SIZE) * 0.5);
+const float MAP_X_END    = ((WINDOW_WIDTH + MAP_SIZE) * 0.5);
+const float MAP_X_CENTER = (MAP_X_BEGIN + ((MAP_X_END - MAP_X_BEGIN) * 0.5));
+
+const float MAP_Y_BEGIN  = ((WINDOW_HEIGHT - MAP_SIZE) * 0.5);
+const float MAP_Y_END    = ((WINDOW_HEIGHT + MAP_SIZE) * 0.5);
+const float MAP_Y_CENTER = (MAP_Y_BEGIN + ((MAP_Y_END - MAP_Y_BEGIN) * 0.5));
+
+// ===================================
+// Simulation numbers.
+// positions, directions and the math on them in the sim go through Sim_Real,
+// Sim_Vec2 and the sim_ functions. by default that's raymath on floats. build
+// with SIM_FIXED_POINT and they're fz_Fixed instead: the same input gives the
+// same bits whatever the compiler or flags, which is what replays and lockstep
+// need. drawing, particles and level geometry stay float; values cross over
+// with sim_vec2() / sim_vector2() at the edges.
+//
+// floats the fixed point sim still takes in, and why they're trusted: each is
+// stored data, or IEEE basic ops with no add to fuse into an FMA, which every
+// compiler has to round the same way. that holds with -ffp-contract=off and
+// without -ffast-math; sim_hash.sh builds that way and compares.
+//   - level geometry: wall ends and normals as stored, converted with sim_vec2().
+//     --level gen: draws them with cosf / sinf, so those levels also need the same libm.
+//   - which wall level_raycast() hits, and level_contains(). where along the
+//     wall the beam lands is sim math again (sim_wall_hit).
+//   - the mouse, as sampled.
+//   - game.timescale: constants and + 0.5. sim_dt() converts it, then multiplies
+//     in Sim_Real.
+//   - the float timers (charge_amount, jump_timer, combo_timer,
+//     state_change_timer, camerashake): one add of timescaled_dt() a tick.
+#if defined(SIM_FIXED_POINT)
+typedef fz_Fixed  Sim_Real;
+typedef fz_Fixed2 Sim_Vec2;
+
+inline Sim_Real sim_real(float f)       { return fz_fixed_from_float(f); }
+inline float    sim_float(Sim_Real r)   { return fz_fixed_to_float(r); }
+inline Sim_Vec2 sim_vec2(Vector2 v)     { return { sim_real(v.x), sim_real(v.y) }; }
+inline Vector2  sim_vector2(Sim_Vec2 v) { return { sim_float(v.x), sim_float(v.y) }; }
+inline int      sim_floor(Sim_Real r)   { return r.raw >> fz_FIXED_BITS; }
+inline bool     sim_less(Sim_Real a, Sim_Real b) { return a.raw < b.raw; }
+
+inline Sim_Real sim_add(Sim_Real a, Sim_Real b)               { return fz_fixed_add(a, b); }
+inline Sim_Real sim_sub(Sim_Real a, Sim_Real b)               { return fz_fixed_sub(a, b); }
+inline Sim_Real sim_mul(Sim_Real a, Sim_Real b)               { return fz_fixed_mul(a, b); }
+inline Sim_Real sim_div(Sim_Real a, Sim_Real b)               { return fz_fixed_div(a, b); }
+inline Sim_Real sim_lerp(Sim_Real a, Sim_Real b, Sim_Real t)  { return fz_fixed_lerp(a, b, t); }
+inline Sim_Vec2 sim_add(Sim_Vec2 a, Sim_Vec2 b)               { return fz_fixed2_add(a, b); }
+inline Sim_Vec2 sim_sub(Sim_Vec2 a, Sim_Vec2 b)               { return fz_fixed2_sub(a, b); }
+inline Sim_Vec2 sim_scale(Sim_Vec2 a, Sim_Real s)             { return fz_fixed2_scale(a, s); }
+inline Sim_Real sim_dot(Sim_Vec2 a, Sim_Vec2 b)               { return fz_fixed2_dot(a, b); }
+inline Sim_Real sim_length(Sim_Vec2 a)                        { return fz_fixed2_length(a); }
+inline Sim_Vec2 sim_normalize(Sim_Vec2 a)                     { return fz_fixed2_normalize(a); }
+inline Sim_Vec2 sim_lerp(Sim_Vec2 a, Sim_Vec2 b, Sim_Real t)  { return fz_fixed2_lerp(a, b, t); }
+
+// every position += direction * step, in one batch.
+inline void sim_advance(Sim_Vec2 *pos, const Sim_Vec2 *dir, Sim_Real step, int count) {
+    fz_fixed2_advance(pos, dir, step, count);
+}
+#else
+typedef float   Sim_Real;
+typedef Vector2 Sim_Vec2;
+
+inline Sim_Real sim_real(float f)       { return f; }
+inline float    sim_float(Sim_Real r)   { return r; }
+inline Sim_Vec2 sim_vec2(Vector2 v)     { return v; }
+inline Vector2  sim_vector2(Sim_Vec2 v) { return v; }
+inline int      sim_floor(Sim_Real r)   { return (int)floorf(r); }
+inline bool     sim_less(Sim_Real a, Sim_Real b) { return a < b; }
+
+inline Sim_Real sim_add(Sim_Real a, Sim_Real b)               { return a + b; }
+inline Sim_Real sim_sub(Sim_Real a, Sim_Real b)               { return a - b; }
+inline Sim_Real sim_mul(Sim_Real a, Sim_Real b)               { return a * b; }
+inline Sim_Real sim_div(Sim_Real a, Sim_Real b)               { return a / b; }
+inline Sim_Real sim_lerp(Sim_Real a, Sim_Real b, Sim_Real t)  { return Lerp(a, b, t); }
+inline Sim_Vec2 sim_add(Sim_Vec2 a, Sim_Vec2 b)               { return Vector2Add(a, b); }
+inline Sim_Vec2 sim_sub(Sim_Vec2 a, Sim_Vec2 b)               { return Vector2Subtract(a, b); }
+inline Sim_Vec2 sim_scale(Sim_Vec2 a, Sim_Real s)             { return Vector2Scale(a, s); }
+inline Sim_Real sim_dot(Sim_Vec2 a, Sim_Vec2 b)               { return Vector2DotProduct(a, b); }
+inline Sim_Real sim_length(Sim_Vec2 a)                        { return Vector2Length(a); }
+inline Sim_Vec2 sim_normalize(Sim_Vec2 a)                     { return Vector2Normalize(a); }
+inline Sim_Vec2 sim_lerp(Sim_Vec2 a, Sim_Vec2 b, Sim_Real t)  { return Vector2Lerp(a, b, t); }
+
+inline void sim_advance(Sim_Vec2 *pos, const Sim_Vec2 *dir, Sim_Real step, int count) {
+    for (int i = 0; i < count; ++i) pos[i] = Vector2Add(pos[i], Vector2Scale(dir[i], step));
+}
+#endif
+
+inline Sim_Real sim_abs(Sim_Real a)                       { return sim_less(a, sim_real(0)) ? sim_sub(sim_real(0), a) : a; }
+inline Sim_Real sim_clamp(Sim_Real a, Sim_Real lo, Sim_Real hi) { return sim_less(a, lo) ? lo : sim_less(hi, a) ? hi : a; }
+
+struct Player {
+    float charge_amount;
+    int   holding_charge;
+
+    int     performing_walljump;
+    float   jump_timer;
+    Vector2 next_normal;
+
+    Sim_Vec2 pos;
+    Vector2  size;
+    Vector2  normal;
+    Sim_Vec2 shoot_direction;
+
+    int surface; // the level ground it stands on.
+};
+
+enum {
+    STATE_TITLE_SCREEN,
+    STATE_TUTORIAL,
+    STATE_PLAYING,
+    STATE_PLAYER_DIED,
+    STATE_LEADERBOARD,
+};
+
+// names an entity for as long as it lives: slot + 1 in the low 16 bits, the
+// slot's generation above. never 0. see entity_get().
+typedef uint32_t Entity_Handle;
+
+struct Game {
+    int     state;
+    int     score;
+
+    int     tutorial_happened;
+
+    float   state_change_timer;
+    float   state_change_max;
+
+    int     additional_score;
+    int     combo;
+    float   combo_timer;
+
+    float   timescale;
+    float   camerashake;
+
+    int      hitting_wall;
+    Sim_Vec2 hit_pos;
+
+    Entity_Handle captured_entity[256];
+    int           captured_entity_count;
+
+    int high_score[32];
+    int high_score_count;
+
+    int tick;           // fixed updates since startup.
+    int run_start_tick;
+    int run_kills;
+};
+
+enum {
+    ENTITY_NONE,
+    ENTITY_ENEMY,
+    ENTITY_BULLET,
+    ENTITY_DEATH,
+};
+
+struct Entity {
+    int type;
+    int being_destroyed;
+    Entity_Handle handle;
+
+    Sim_Vec2 position;
+    fz_Timer_Handle timer; // TIMER_ENEMY_FIRE or TIMER_DEATH_EXPIRE; 0 when none.
+
+    Sim_Vec2 direction;
+    Sim_Vec2 target;
+};
+
+// ===================================
+// Simulation state.
+// everything that changes while the game runs lives in this one block,
+// so it can be snapshotted, restored or saved with a memcpy.
+// no pointers in here: the block has to stay relocatable.
+#define SIM_TIMERS             1280 // an enemy or death marker each, plus the spawner.
+#define TIMER_UNITS_PER_SECOND 1000
+#define MAX_ENTITIES           1024
+
+// where a handle leads. a slot keeps its number for the entity's whole life
+// while the entity itself moves around in entities[].
+struct Entity_Slot {
+    uint16_t dense;      // index into entities[] while alive; the next free slot + 1 while free.
+    uint16_t generation; // bumped on every destroy, so handles to the old entity stop resolving.
+};
+
+struct Sim_State {
+    Game     game;
+    Player   player;
+    Camera2D camera;
+
+    // live entities packed at the front, in no particular order: passes only
+    // ever walk entity_count of them. handles go through entity_slots.
+    Entity      entities[MAX_ENTITIES];
+    int         entity_count;
+    Entity_Slot entity_slots[MAX_ENTITIES];
+    int         entity_slot_count; // slots ever handed out; the ones past it were never touched.
+    int         entity_free_slot;  // + 1, 0 when none: the head of the free slots.
+
+    fz_Timing_Wheel<SIM_TIMERS> timers; // in TIMER_UNITS_PER_SECOND of scaled game time.
+    Sim_Real timer_carry;                // fraction of a unit not advanced yet.
+
+    fz_Rng rng; // gameplay draws only: rewinding or loading replays the same ones.
+
+    Sim_Real accel; // update_player_input()'s movement smoothing.
+};
+
+static Sim_State sim;
+
+static Game     &game     = sim.game;
+static Player   &player   = sim.player;
+static Camera2D &camera   = sim.camera;
+static Entity  (&entities)[fz_COUNTOF(sim.entities)] = sim.entities;
+
+// cosmetic streams, split from the same seed as sim.rng but never drawn from by
+// gameplay: shake and particles can change all they want without moving the sim.
+static fz_Rng shake_rng; // simulation thread.
+
+// GetRandomValue, on the gameplay stream.
+inline int sim_random(int lo, int hi) {
+    return fz_rng_range(&sim.rng, lo, hi);
+}
+
+// ===================================
+// Timers.
+// countdowns that used to be decremented every tick (enemy fire, death
+// markers, the spawner) are timers in sim.timers instead. the wheel advances
+// by scaled game time, and anything that isn't due costs nothing per tick.
+enum {
+    TIMER_ENEMY_FIRE,   // user: entity handle.
+    TIMER_DEATH_EXPIRE, // user: entity handle.
+    TIMER_ENEMY_SPAWN,
+};
+
+inline fz_Timer_Handle timer_start(float seconds, int kind, uint32_t user = 0) {
+    return sim.timers.schedule((uint64_t)(seconds * TIMER_UNITS_PER_SECOND), kind, user);
+}
+
+inline void timer_cancel(fz_Timer_Handle *handle) {
+    sim.timers.cancel(*handle);
+    *handle = 0;
+}
+
+inline float timer_remaining(fz_Timer_Handle handle) {
+    return (float)sim.timers.remaining(handle) / TIMER_UNITS_PER_SECOND;
+}
+
+// ===================================
+// Entities.
+// spawning appends to entities[], destroying moves the last one into the hole,
+// so a pointer is only good until the next destroy. anything that holds on to
+// an entity longer (timers, captures) keeps its handle instead.
+inline int entity_slot_of(Entity_Handle handle) {
+    return (int)(handle & 0xFFFF) - 1;
+}
+
+//! @return the entity, or NULL if it has been destroyed since the handle was made.
+inline Entity *entity_get(Entity_Handle handle) {
+    int slot = entity_slot_of(handle);
+    if (slot < 0 || slot >= sim.entity_slot_count) return NULL;
+
+    const Entity_Slot *s = &sim.entity_slots[slot];
+    if (s->generation != (handle >> 16)) return NULL;
+    return &entities[s->dense];
+}
+
+//! @return the new entity, or NULL when there's no room.
+Entity *spawn_entity(int type) {
+    if (sim.entity_count >= MAX_ENTITIES) return NULL;
+
+    int slot;
+    if (sim.entity_free_slot) {
+        slot = sim.entity_free_slot - 1;
+        sim.entity_free_slot = sim.entity_slots[slot].dense;
+    } else {
+        slot = sim.entity_slot_count++;
+    }
+
+    Entity_Slot *s = &sim.entity_slots[slot];
+    s->dense = (uint16_t)sim.entity_count;
+
+    Entity *e = &entities[sim.entity_count++];
+    memset(e, 0, sizeof(*e));
+    e->type   = type;
+    e->handle = ((Entity_Handle)s->generation << 16) | (Entity_Handle)(slot + 1);
+    return e;
+}
+
+// the last entity takes e's place, so e points at a different one afterwards.
+void destroy_entity(Entity *e) {
+    timer_cancel(&e->timer);
+
+    int slot = entity_slot_of(e->handle);
+    Entity_Slot *s = &sim.entity_slots[slot];
+    s->generation += 1;
+    s->dense = (uint16_t)sim.entity_free_slot;
+    sim.entity_free_slot = slot + 1;
+
+    Entity *last = &entities[--sim.entity_count];
+    if (e != last) {
+        *e = *last;
+        sim.entity_slots[entity_slot_of(e->handle)].dense = (uint16_t)(e - entities);
+    }
+}
+
+void entities_clear() {
+    while (sim.entity_count > 0) destroy_entity(&entities[sim.entity_count - 1]);
+}
+
+// ===================================
+// Level geometry.
+// walls are one-sided segments. the first loop of a level is the arena and
+// faces in, every loop after it is an obstacle and faces out; which way the
+// points wind doesn't matter, the normals come out of the winding.
+//
+// every query goes through a BVH over the segments: a flat node array, the
+// two children of a node side by side, leaves pointing at runs of grounds.
+// beams, nearest-wall and inside tests stay logarithmic in the wall count.
+// the level is built before the simulation starts and only read after that,
+// so both threads query it without a lock.
+#define LEVEL_LEAF_SIZE   4
+#define LEVEL_STACK_DEPTH 64 // median splits: enough for far more walls than fit in an int.
+
+struct Ground {
+    Vector2 begin;
+    Vector2 end;
+
+    Vector2 normal;
+};
+
+struct Level_Node {
+    Vector2 min;
+    Vector2 max;
+    int first; // leaf: first ground. inner: left child, the right one follows it.
+    int count; // grounds in a leaf; 0 for inner nodes.
+};
+
+struct Level {
+    fz_Array<Ground>     grounds;
+    fz_Array<Level_Node> nodes;
+
+    Vector2  min;
+    Vector2  max;
+    Vector2  spawn;         // the middle of the arena.
+    int      spawn_surface; // what the player stands on there.
+    uint32_t hash;          // of the grounds: saves refer to them by index.
+};
+
+static Level level;
+
+// the way x_axis moves along a surface. rounded to the closest axis, this is
+// what the old per-wall controls did: right on floors, left on ceilings, up the
+// left wall and down the right one.
+inline Vector2 surface_tangent(Vector2 n) {
+    if (fabsf(n.y) >= fabsf(n.x)) return { -n.y, n.x };
+    return { n.y, -n.x };
+}
+
+inline float cross2(Vector2 a, Vector2 b) {
+    return a.x * b.y - a.y * b.x;
+}
+
+//! a closed loop of points. the first one added is the arena.
+void level_add_loop(Level *l, const Vector2 *points, int count) {
+    float area = 0;
+    for (int i = 0; i < count; ++i) area += cross2(points[i], points[(i + 1) % count]);
+
+    // with y pointing down, a positive area means the left-hand normal points in.
+    float side = (area > 0 ? 1 : -1) * (l->grounds.empty() ? 1 : -1);
+
+    for (int i = 0; i < count; ++i) {
+        Ground g;
+        g.begin = points[i];
+        g.end   = points[(i + 1) % count];
+
+        Vector2 d = Vector2Subtract(g.end, g.begin);
+        if (d.x == 0 && d.y == 0) continue;
+        g.normal = Vector2Scale(Vector2Normalize({ -d.y, d.x }), side);
+        l->grounds.push(g);
+    }
+}
+
+inline Vector2 ground_center(const Ground *g) {
+    return Vector2Scale(Vector2Add(g->begin, g->end), 0.5f);
+}
+
+inline void box_grow(Vector2 *min, Vector2 *max, Vector2 p) {
+    min->x = fminf(min->x, p.x); min->y = fminf(min->y, p.y);
+    max->x = fmaxf(max->x, p.x); max->y = fmaxf(max->y, p.y);
+}
+
+// fills in nodes[index] for grounds [first, first + count).
+void level_build_node(Level *l, int index, int first, int count) {
+    Level_Node node = {};
+    node.min = {  FLT_MAX,  FLT_MAX };
+    node.max = { -FLT_MAX, -FLT_MAX };
+
+    Vector2 cmin = node.min, cmax = node.max;
+    for (int i = first; i < first + count; ++i) {
+        const Ground *g = &l->grounds[i];
+        box_grow(&node.min, &node.max, g->begin);
+        box_grow(&node.min, &node.max, g->end);
+        box_grow(&cmin, &cmax, ground_center(g));
+    }
+
+    if (count <= LEVEL_LEAF_SIZE) {
+        node.first = first;
+        node.count = count;
+        l->nodes[index] = node;
+        return;
+    }
+
+    // median on the wider axis of the centers: halves every step, so depth is log2.
+    int axis = (cmax.x - cmin.x) >= (cmax.y - cmin.y) ? 0 : 1;
+    Ground *begin = &l->grounds[first];
+    std::nth_element(begin, begin + count / 2, begin + count, [axis](const Ground &a, const Ground &b) {
+        Vector2 ca = ground_center(&a), cb = ground_center(&b);
+        return axis == 0 ? ca.x < cb.x : ca.y < cb.y;
+    });
+
+    node.first = (int)l->nodes.count();
+    node.count = 0;
+    l->nodes[index] = node;
+
+    l->nodes.push({});
+    l->nodes.push({});
+    level_build_node(l, node.first,     first,             count / 2);
+    level_build_node(l, node.first + 1, first + count / 2, count - count / 2);
+}
+
+// front side only: a beam passes through the back of a wall.
+inline bool ground_raycast(const Ground *g, Vector2 a, Vector2 d, float *t) {
+    if (Vector2DotProduct(d, g->normal) >= 0) return false;
+
+    Vector2 e = Vector2Subtract(g->end, g->begin);
+    float denom = cross2(d, e);
+    if (denom == 0) return false;
+
+    Vector2 ap = Vector2Subtract(g->begin, a);
+    float s = cross2(ap, e) / denom; // along the beam.
+    float u = cross2(ap, d) / denom; // along the wall.
+    if (s < 0 || s >= *t || u < 0 || u > 1) return false;
+
+    *t = s;
+    return true;
+}
+
+// where along a + d*t the beam enters the box, if it does before `t`.
+inline bool box_raycast(Vector2 min, Vector2 max, Vector2 a, Vector2 inv, float t, float *enter) {
+    float t0 = 0, t1 = t;
+    float lo[2] = { min.x, min.y }, hi[2] = { max.x, max.y };
+    float o[2]  = { a.x, a.y },     id[2] = { inv.x, inv.y };
+
+    for (int axis = 0; axis < 2; ++axis) {
+        if (isinf(id[axis])) {
+            if (o[axis] < lo[axis] || o[axis] > hi[axis]) return false;
+            continue;
+        }
+        float n = (lo[axis] - o[axis]) * id[axis];
+        float f = (hi[axis] - o[axis]) * id[axis];
+        if (n > f) { float tmp = n; n = f; f = tmp; }
+        t0 = fmaxf(t0, n);
+        t1 = fminf(t1, f);
+        if (t0 > t1) return false;
+    }
+    *enter = t0;
+    return true;
+}
+
+//! the closest wall the segment a-b runs into, skipping `ignore`.
+//! @return its index, or -1. how far along a-b it is (0..1) goes in *hit_t.
+int level_raycast(const Level *l, Vector2 a, Vector2 b, int ignore, float *hit_t) {
+    if (l->nodes.empty()) return -1;
+
+    Vector2 d   = Vector2Subtract(b, a);
+    Vector2 inv = { 1.0f / d.x, 1.0f / d.y };
+    float   t   = 1;
+    int     best = -1;
+
+    int stack[LEVEL_STACK_DEPTH];
+    int top = 0;
+    float enter;
+    if (!box_raycast(l->nodes[0].min, l->nodes[0].max, a, inv, t, &enter)) return -1;
+    stack[top++] = 0;
+
+    while (top) {
+        const Level_Node *node = &l->nodes[stack[--top]];
+
+        if (node->count) {
+            for (int i = node->first; i < node->first + node->count; ++i) {
+                if (i != ignore && ground_raycast(&l->grounds[i], a, d, &t)) best = i;
+            }
+            continue;
+        }
+
+        // nearer child on top: once it hits, the far one mostly gets culled.
+        float tl, tr;
+        int left  = node->first, right = node->first + 1;
+        bool hl = box_raycast(l->nodes[left].min,  l->nodes[left].max,  a, inv, t, &tl);
+        bool hr = box_raycast(l->nodes[right].min, l->nodes[right].max, a, inv, t, &tr);
+        if (hl && hr) {
+            if (tl < tr) { stack[top++] = right; stack[top++] = left; }
+            else         { stack[top++] = left;  stack[top++] = right; }
+        } else if (hl) {
+            stack[top++] = left;
+        } else if (hr) {
+            stack[top++] = right;
+        }
+    }
+
+    if (best != -1) *hit_t = t;
+    return best;
+}
+
+inline float box_distance_sqr(Vector2 min, Vector2 max, Vector2 p) {
+    float dx = fmaxf(fmaxf(min.x - p.x, 0), p.x - max.x);
+    float dy = fmaxf(fmaxf(min.y - p.y, 0), p.y - max.y);
+    return dx * dx + dy * dy;
+}
+
+inline Vector2 ground_closest(const Ground *g, Vector2 p) {
+    Vector2 e = Vector2Subtract(g->end, g->begin);
+    float u = Vector2DotProduct(Vector2Subtract(p, g->begin), e) / Vector2DotProduct(e, e);
+    return Vector2Add(g->begin, Vector2Scale(e, Clamp(u, 0, 1)));
+}
+
+//! the wall closest to p. @return its index, or -1 for an empty level.
+int level_nearest(const Level *l, Vector2 p, Vector2 *closest, float *distance) {
+    if (l->nodes.empty()) return -1;
+
+    float best_sqr = FLT_MAX;
+    int   best     = -1;
+
+    int stack[LEVEL_STACK_DEPTH];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top) {
+        const Level_Node *node = &l->nodes[stack[--top]];
+        if (box_distance_sqr(node->min, node->max, p) >= best_sqr) continue;
+
+        if (node->count) {
+            for (int i = node->first; i < node->first + node->count; ++i) {
+                Vector2 c = ground_closest(&l->grounds[i], p);
+                float   d = Vector2DistanceSqr(c, p);
+                if (d < best_sqr) {
+                    best_sqr = d;
+                    best     = i;
+                    *closest = c;
+                }
+            }
+            continue;
+        }
+
+        int left = node->first, right = node->first + 1;
+        float dl = box_distance_sqr(l->nodes[left].min,  l->nodes[left].max,  p);
+        float dr = box_distance_sqr(l->nodes[right].min, l->nodes[right].max, p);
+        if (dl < dr) { stack[top++] = right; stack[top++] = left; }
+        else         { stack[top++] = left;  stack[top++] = right; }
+    }
+
+    *distance = sqrtf(best_sqr);
+    return best;
+}
+
+//! inside the arena and outside every obstacle: walls crossed going right from p is odd.
+bool level_contains(const Level *l, Vector2 p) {
+    if (l->nodes.empty()) return false;
+
+    int crossings = 0;
+    int stack[LEVEL_STACK_DEPTH];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top) {
+        const Level_Node *node = &l->nodes[stack[--top]];
+        if (p.y < node->min.y || p.y > node->max.y || p.x > node->max.x) continue;
+
+        if (node->count) {
+            for (int i = node->first; i < node->first + node->count; ++i) {
+                Vector2 a = l->grounds[i].begin, b = l->grounds[i].end;
+                if ((a.y > p.y) == (b.y > p.y)) continue;
+                float x = a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y);
+                crossings += x > p.x;
+            }
+            continue;
+        }
+        stack[top++] = node->first;
+        stack[top++] = node->first + 1;
+    }
+    return crossings & 1;
+}
+
+//! where the center of a player standing on `surface` goes: half a tile off the
+//! wall, and at least half a tile from its ends so it doesn't hang past corners.
+//! sim numbers: only the wall's stored ends and normal come in as floats.
+Sim_Vec2 level_attach(const Level *l, int surface, Sim_Vec2 center) {
+    const Ground *g = &l->grounds[surface];
+    Sim_Vec2 begin = sim_vec2(g->begin);
+    Sim_Vec2 e     = sim_sub(sim_vec2(g->end), begin);
+    Sim_Real len   = sim_length(e);
+    Sim_Vec2 dir   = sim_normalize(e);
+    Sim_Real half  = sim_real(HALF_TILE);
+
+    Sim_Real u = sim_dot(sim_sub(center, begin), dir);
+    u = sim_less(sim_real(TILE_SIZE), len) ? sim_clamp(u, half, sim_sub(len, half)) : sim_mul(len, sim_real(0.5f));
+
+    return sim_add(sim_add(begin, sim_scale(dir, u)), sim_scale(sim_vec2(g->normal), half));
+}
+
+//! where a beam from `from` along the unit `dir` meets the line through wall g,
+//! in sim numbers: level_raycast() picks the wall, this places the hit.
+//! @return false when the beam runs along the wall or away from it.
+inline bool sim_wall_hit(const Ground *g, Sim_Vec2 from, Sim_Vec2 dir, Sim_Vec2 *hit) {
+    Sim_Vec2 n      = sim_vec2(g->normal);
+    Sim_Real facing = sim_dot(dir, n);
+    if (!sim_less(facing, sim_real(0))) return false;
+
+    Sim_Real along = sim_div(sim_dot(sim_sub(sim_vec2(g->begin), from), n), facing);
+    *hit = sim_add(from, sim_scale(dir, along));
+    return true;
+}
+
+//! somewhere inside the level at least `inset` from every wall. the first try
+//! draws x then y off the bounds, which in the box is all the old spawns did.
+Vector2 level_random_point(const Level *l, float inset, fz_Rng *rng) {
+    for (int tries = 0; tries < 32; ++tries) {
+        Vector2 p;
+        p.x = fz_rng_range(rng, (int)(l->min.x + inset), (int)(l->max.x - inset));
+        p.y = fz_rng_range(rng, (int)(l->min.y + inset), (int)(l->max.y - inset));
+
+        Vector2 closest;
+        float   distance;
+        if (level_contains(l, p) && level_nearest(l, p, &closest, &distance) != -1 && distance >= inset) {
+            return p;
+        }
+    }
+    return l->spawn;
+}
+
+//! builds the BVH once every loop is in.
+void level_finish(Level *l) {
+    int count = (int)l->grounds.count();
+    assert(count > 0);
+
+    l->nodes.clear();
+    l->nodes.reserve(2 * count);
+    l->nodes.push({});
+    level_build_node(l, 0, 0, count);
+
+    l->min  = l->nodes[0].min;
+    l->max  = l->nodes[0].max;
+    l->hash = fz_fnv1a_32(l->grounds.data, count * sizeof(Ground));
+
+    // start on the floor below the middle, or the closest wall if there's none.
+    l->spawn = Vector2Scale(Vector2Add(l->min, l->max), 0.5f);
+    float t;
+    l->spawn_surface = level_raycast(l, l->spawn, { l->spawn.x, l->max.y + 1 }, -1, &t);
+    if (l->spawn_surface == -1) {
+        Vector2 closest;
+        float   distance;
+        l->spawn_surface = level_nearest(l, l->spawn, &closest, &distance);
+    }
+}
+
+// the map the game always had.
+void level_box(Level *l) {
+    Vector2 corners[] = {
+        { MAP_X_BEGIN, MAP_Y_BEGIN }, { MAP_X_END, MAP_Y_BEGIN },
+        { MAP_X_END,   MAP_Y_END   }, { MAP_X_BEGIN, MAP_Y_END },
+    };
+    level_add_loop(l, corners, fz_COUNTOF(corners));
+    level_finish(l);
+}
+
+//! one loop per line, "x y x y ..." in window pixels; '#' comments out a line.
+bool level_load(Level *l, const char *path) {
+    fz_File_Map map = fz_file_map(path);
+    if (!map.data) return false;
+
+    // strtof wants a terminator the mapping doesn't have.
+    char *text = (char *)fz_alloc(map.size + 1);
+    memcpy(text, map.data, map.size);
+    text[map.size] = 0;
+    fz_file_unmap(&map);
+
+    fz_Array<Vector2> points;
+    for (char *line = text; *line; ) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = 0;
+        else      next = line + strlen(line);
+
+        points.clear();
+        char *cursor = line;
+        while (*line != '#') {
+            char *end;
+            float x = strtof(cursor, &end);
+            if (end == cursor) break;
+            cursor = end;
+
+            float y = strtof(cursor, &end);
+            if (end == cursor) break;
+            cursor = end;
+
+            points.push({ x, y });
+        }
+        if (points.count() >= 3) level_add_loop(l, points.data, (int)points.count());
+
+        line = next;
+    }
+
+    fz_free(text);
+    if (l->grounds.empty()) return false;
+
+    level_finish(l);
+    return true;
+}
+
+//! a jagged, concave ring around the map with pillars scattered inside it,
+//! about `walls` segments in all. a pillar that would touch the ring or another
+//! pillar is drawn again, and dropped after enough misses. for --level gen:<n>
+//! and the benchmark.
+void level_generate(Level *l, int walls, fz_Rng *rng) {
+    int ring    = walls / 2 < 8 ? 8 : walls / 2;
+    int pillars = (walls - ring) / 4;
+
+    Vector2 center = { MAP_X_CENTER, MAP_Y_CENTER };
+    float   radius = MAP_SIZE * 0.5f;
+
+    fz_Array<Vector2> points;
+    for (int i = 0; i < ring; ++i) {
+        float angle = (2 * PI * i) / ring;
+        float r     = radius * fz_rng_range_f32(rng, 0.8f, 1.0f);
+        points.push(Vector2Add(center, { cosf(angle) * r, sinf(angle) * r }));
+    }
+    level_add_loop(l, points.data, ring);
+
+    // the ring on its own first: level_nearest() on it keeps pillars off the edge.
+    level_finish(l);
+
+    // small enough that a few thousand of them still leave room to move, and
+    // to find a free spot for each without many misses.
+    float size  = Clamp(radius * 2 / sqrtf((float)(pillars + 1)) * 0.125f, 1.0f, TILE_SIZE);
+    float reach = size * 1.4142136f; // middle to corner.
+
+    // a cell is a pillar wide on each side: two middles in the same cell would
+    // overlap, so one per cell, and only the 8 around can touch a new one.
+    float cell = 2 * size;
+    int   side = (int)ceilf(2 * radius / cell) + 1;
+    Vector2 origin = { center.x - radius, center.y - radius };
+    fz_Array<int> grid; // pillar + 1; 0 when empty.
+    grid.resize(side * side);
+
+    fz_Array<Vector2> middles;
+    for (int tries = pillars * 8; tries > 0 && (int)middles.count() < pillars; --tries) {
+        float angle = fz_rng_range_f32(rng, 0, 2 * PI);
+        float r     = radius * 0.7f * sqrtf(fz_rng_f32(rng));
+        Vector2 c   = Vector2Add(center, { cosf(angle) * r, sinf(angle) * r });
+
+        int  gx = (int)((c.x - origin.x) / cell);
+        int  gy = (int)((c.y - origin.y) / cell);
+        bool fits = true;
+        for (int y = gy - 1; y <= gy + 1 && fits; ++y) {
+            for (int x = gx - 1; x <= gx + 1 && fits; ++x) {
+                if (x < 0 || y < 0 || x >= side || y >= side) continue;
+
+                int other = grid[y * side + x];
+                if (other && fabsf(middles[other - 1].x - c.x) <= cell && fabsf(middles[other - 1].y - c.y) <= cell) fits = false;
+            }
+        }
+
+        Vector2 closest;
+        float   distance;
+        if (fits && level_nearest(l, c, &closest, &distance) != -1 && distance <= reach) fits = false;
+        if (!fits) continue;
+
+        middles.push(c);
+        grid[gy * side + gx] = (int)middles.count();
+    }
+
+    for (int i = 0; i < (int)middles.count(); ++i) {
+        Vector2 c = middles[i];
+        Vector2 quad[] = {
+            { c.x - size, c.y - size }, { c.x + size, c.y - size },
+            { c.x + size, c.y + size }, { c.x - size, c.y + size },
+        };
+        level_add_loop(l, quad, fz_COUNTOF(quad));
+    }
+    level_finish(l);
+}
+
+// every wall, one by one: what the BVH is measured and checked against.
+int level_raycast_brute(const Level *l, Vector2 a, Vector2 b, int ignore, float *hit_t) {
+    Vector2 d = Vector2Subtract(b, a);
+    float   t = 1;
+    int     best = -1;
+    for (int i = 0; i < (int)l->grounds.count(); ++i) {
+        if (i != ignore && ground_raycast(&l->grounds[i], a, d, &t)) best = i;
+    }
+    if (best != -1) *hit_t = t;
+    return best;
+}
+
+static volatile int level_bench_sink; // keeps the timed loops from being thrown out.
+
+//! --bench-level: beam and nearest-wall cost as levels grow. full-length beams
+//! from random spots inside, so most of them cross the whole arena.
+void level_benchmark() {
+    const int RAYS = 1 << 14;
+    fz_Rng rng;
+    fz_rng_seed(&rng, 1);
+
+    printf("[level] %8s %12s %12s %12s %10s\n", "walls", "beam ns", "brute ns", "nearest ns", "mismatch");
+    for (int walls = 16; walls <= 65536; walls *= 4) {
+        Level l;
+        level_generate(&l, walls, &rng);
+
+        fz_Array<Vector2> from, to;
+        for (int i = 0; i < RAYS; ++i) {
+            from.push(level_random_point(&l, 0, &rng));
+            float angle = fz_rng_range_f32(&rng, 0, 2 * PI);
+            to.push(Vector2Add(from[i], Vector2Scale({ cosf(angle), sinf(angle) }, MAP_SIZE * 1.55f)));
+        }
+
+        using Clock = std::chrono::steady_clock;
+        int checksum = 0, mismatch = 0;
+        Vector2 closest;
+        float hit, distance;
+
+        auto t0 = Clock::now();
+        for (int i = 0; i < RAYS; ++i) checksum += level_raycast(&l, from[i], to[i], -1, &hit);
+        auto t1 = Clock::now();
+        for (int i = 0; i < RAYS; ++i) checksum -= level_raycast_brute(&l, from[i], to[i], -1, &hit);
+        auto t2 = Clock::now();
+        for (int i = 0; i < RAYS; ++i) checksum += level_nearest(&l, from[i], &closest, &distance);
+        auto t3 = Clock::now();
+
+        // same wall both ways; a tie on a shared corner may pick either.
+        for (int i = 0; i < RAYS; ++i) {
+            float a, b;
+            int x = level_raycast(&l, from[i], to[i], -1, &a);
+            int y = level_raycast_brute(&l, from[i], to[i], -1, &b);
+            if (x != y && (x == -1 || y == -1 || fabsf(a - b) > 1e-5f)) mismatch += 1;
+        }
+
+        auto ns = [](Clock::time_point a, Clock::time_point b) {
+            return std::chrono::duration<double, std::nano>(b - a).count() / RAYS;
+        };
+        printf("[level] %8d %12.1f %12.1f %12.1f %10d\n", (int)l.grounds.count(),
+               ns(t0, t1), ns(t1, t2), ns(t2, t3), mismatch);
+        level_bench_sink = checksum;
+    }
+}
+
+// NULL until the asset manager has them loaded.
+static Font *main_font;
+static Font *bigger_font;
+const int MAINFONTSIZE = 58;
+const int BIGFONTSIZE  = 96;
+
+// no window, no GL context, no audio device: --render-replay. fonts stay on the CPU.
+static int headless;
+
+enum {
+    SOUND_GOT_HIT,
+    SOUND_SHOT_BULLET,
+    SOUND_ENEMY_DIED,
+    SOUND_TELEPORTED,
+    SOUND_SPAWN_ENEMY,
+};
+
+struct Music_Stream;
+
+static Sound        *sounds[8];
+static Music_Stream *game_music;
+
+// everything that goes through fz_global_allocator. only counts with -Dfz_ALLOC_STATS.
+static fz_Alloc_Stats global_alloc_stats;
+
+// ===================================
+// Frame arena.
+// scratch memory for anything that only lives for one tick or one render:
+// formatted strings, draw lists, query results.
+// game_update() and draw_game_screen() each open a temp block on it, so it's
+// back to empty at the top of every tick and every render.
+// with --threaded-sim the simulation thread gets an arena of its own.
+// both are virtual: FRAME_ARENA_RESERVE is address space, and only the pages a
+// busy frame actually reached are ever committed. every FRAME_ARENA_TRIM frames
+// the pages none of them reached since go back (frame_arena_trim).
+#define FRAME_ARENA_RESERVE (256 * fz_MB)
+#define FRAME_ARENA_TRIM    600 // ~10 s of ticks or frames at 60 a second.
+static fz_Arena render_arena;
+static fz_Arena tick_arena;
+
+//! fz_arena_init_virtual, but nothing runs without these: a range that can't
+//! be reserved ends the program.
+void arena_reserve(fz_Arena *arena, size_t size, uint32_t pages, const char *name) {
+    if (fz_arena_init_virtual(arena, size, pages)) return;
+
+    fprintf(stderr, "[memory] could not reserve %zu MB of address space for the %s arena\n", size / fz_MB, name);
+    exit(1);
+}
+
+//! between frames, with nothing left in the arena. every FRAME_ARENA_TRIM calls
+//! it decommits what's past the busiest frame since the last trim.
+void frame_arena_trim(fz_Arena *arena, int *frames) {
+    assert(arena->used == 0 && "frame arena still in use between frames.");
+    if (++*frames < FRAME_ARENA_TRIM) return;
+
+    *frames = 0;
+    fz_arena_reset(arena);
+}
+
+static thread_local fz_Arena *thread_frame_arena = &render_arena;
+
+inline fz_Arena &frame_arena() {
+    return *thread_frame_arena;
+}
+
+inline fz_Allocator frame_allocator() {
+    return fz_arena_allocator(thread_frame_arena);
+}
+
+// the same arena as a policy: containers that live in it bump inline.
+inline fz_Arena_Policy frame_policy() {
+    return fz_Arena_Policy(thread_frame_arena);
+}
+
+// TextFormat, but the string lives in the frame arena instead of raylib's ring.
+const char *frame_format(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int length = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    char *result = (char *)frame_policy().allocate(length + 1, 1);
+    va_start(args, fmt);
+    vsnprintf(result, length + 1, fmt, args);
+    va_end(args);
+
+    return result;
+}
+
+// ===================================
+// Heap guard.
+// once startup is over nothing should reach the global allocator anymore;
+// per-frame memory comes from frame_arena. debug builds assert on the first offender.
+static fz_Allocator heap_guard_inner;
+static int          heap_guard_armed;
+static size_t       heap_guard_hits;
+
+fz_OPER_FUNC(heap_guard_operation) {
+    if (heap_guard_armed && op != fz_MEMORY_OPER_FREE) {
+        heap_guard_hits += 1;
+        fprintf(stderr, "[frame] heap allocation of %zu bytes after startup (%zu so far).\n", size, heap_guard_hits);
+        assert(!"heap allocation after startup. use frame_arena for per-frame memory.");
+    }
+    return heap_guard_inner.oper_func(op, ptr, old_size, size, alignment, heap_guard_inner.user_data);
+}
+
+// ===================================
+// Draw list.
+// drawing is recorded into the frame arena first, then submitted to raylib in one go.
+enum {
+    DRAW_RECT,
+    DRAW_LINE,
+    DRAW_CIRCLE,
+    DRAW_CIRCLE_LINES,
+    DRAW_TEXT,
+    DRAW_SCISSOR_BEGIN,
+    DRAW_SCISSOR_END,
+    DRAW_PARTICLES,
+};
+
+struct Particle_Pool;
+
+struct Draw_Cmd {
+    int   type;
+    Color color;
+
+    Vector2 a;    // position, line begin, scissor origin.
+    Vector2 b;    // size, line end, scissor size.
+    float   size; // thickness, radius, font size.
+
+    Font       *font; // NULL: raylib's default font.
+    const char *text; // lives in frame_arena (or is a literal).
+
+    Particle_Pool *particles;
+};
+
+typedef fz_Array<Draw_Cmd, 0, fz_Arena_Policy> Draw_List;
+
+inline Draw_Cmd *push_draw(Draw_List *dl, int type, Color color) {
+    Draw_Cmd *cmd = &dl->push({});
+    cmd->type  = type;
+    cmd->color = color;
+    return cmd;
+}
+
+void push_rect(Draw_List *dl, Vector2 pos, Vector2 size, Color color) {
+    Draw_Cmd *cmd = push_draw(dl, DRAW_RECT, color);
+    cmd->a = pos;
+    cmd->b = size;
+}
+
+void push_line(Draw_List *dl, Vector2 begin, Vector2 end, float thick, Color color) {
+    Draw_Cmd *cmd = push_draw(dl, DRAW_LINE, color);
+    cmd->a    = begin;
+    cmd->b    = end;
+    cmd->size = thick;
+}
+
+void push_circle(Draw_List *dl, Vector2 center, float radius, Color color) {
+    Draw_Cmd *cmd = push_draw(dl, DRAW_CIRCLE, color);
+    cmd->a    = center;
+    cmd->size = radius;
+}
+
+void push_circle_lines(Draw_List *dl, Vector2 center, float radius, Color color) {
+    Draw_Cmd *cmd = push_draw(dl, DRAW_CIRCLE_LINES, color);
+    cmd->a    = center;
+    cmd->size = radius;
+}
+
+void push_text(Draw_List *dl, Font *font, const char *text, Vector2 pos, float size, Color color) {
+    Draw_Cmd *cmd = push_draw(dl, DRAW_TEXT, color);
+    cmd->font = font;
+    cmd->text = text;
+    cmd->a    = pos;
+    cmd->size = size;
+}
+
+void push_scissor(Draw_List *dl, float x, float y, float w, float h) {
+    Draw_Cmd *cmd = push_draw(dl, DRAW_SCISSOR_BEGIN, BLACK);
+    cmd->a = { x, y };
+    cmd->b = { w, h };
+}
+
+void pop_scissor(Draw_List *dl) {
+    push_draw(dl, DRAW_SCISSOR_END, BLACK);
+}
+
+void draw_particles(const Particle_Pool *p);
+
+void submit_draw_list(Draw_List *dl) {
+    for (Draw_Cmd &cmd : *dl) {
+        switch(cmd.type) {
+            case DRAW_RECT:         DrawRectangleV(cmd.a, cmd.b, cmd.color); break;
+            case DRAW_LINE:         DrawLineEx(cmd.a, cmd.b, cmd.size, cmd.color); break;
+            case DRAW_CIRCLE:       DrawCircle(cmd.a.x, cmd.a.y, cmd.size, cmd.color); break;
+            case DRAW_CIRCLE_LINES: DrawCircleLines(cmd.a.x, cmd.a.y, cmd.size, cmd.color); break;
+            case DRAW_TEXT:
+            {
+                if (cmd.font) DrawTextEx(*cmd.font, cmd.text, cmd.a, cmd.size, 0, cmd.color);
+                else          DrawText(cmd.text, cmd.a.x, cmd.a.y, cmd.size, cmd.color);
+            } break;
+            case DRAW_SCISSOR_BEGIN: BeginScissorMode(cmd.a.x, cmd.a.y, cmd.b.x, cmd.b.y); break;
+            case DRAW_SCISSOR_END:   EndScissorMode(); break;
+            case DRAW_PARTICLES:     draw_particles(cmd.particles); break;
+
+            default:
+                assert(!"unknown draw command.");
+        }
+    }
+}
+
+// ===================================
+// Music streaming.
+// the track is decoded ahead into a ring of frames. the audio thread
+// (see audio_thread_main) tops it up and feeds raylib's stream from it. the
+// decoder rewinds the moment it runs dry, so a loop lands on the exact next
+// frame. fades are a per-frame gain ramp applied while copying out of the
+// ring; pitch is left alone.
+// WAV is always supported. with MUSIC_VORBIS defined, .ogg files decode
+// through the stb_vorbis that raylib already links in.
+#define MUSIC_UPDATE_FRAMES 2048   // frames handed to raylib per refill (one sub-buffer).
+#define MUSIC_DECODE_FRAMES 4096   // frames decoded per chunk.
+#define MUSIC_RING_FRAMES   32768  // ~0.75 s at 44.1kHz.
+#define MUSIC_FADE_SECONDS  0.5
+
+#if defined(MUSIC_VORBIS)
+// declarations only, from the same stb_vorbis.c raylib compiled in: build with
+// -DMUSIC_VORBIS -I<raylib>/src/external so the two can't drift apart.
+#define STB_VORBIS_HEADER_ONLY
+#include "stb_vorbis.c"
+#endif
+
+enum {
+    MUSIC_SOURCE_NONE,
+    MUSIC_SOURCE_WAV,
+    MUSIC_SOURCE_VORBIS,
+};
+
+// a decoder that hands out interleaved 16-bit frames.
+struct Music_Source {
+    int          kind;
+    unsigned int sample_rate;
+    unsigned int channels; // 1 or 2.
+    size_t       file_size;
+
+    // wav
+    FILE        *file;
+    long         data_offset;
+    unsigned int data_frames;
+    unsigned int position;
+
+#if defined(MUSIC_VORBIS)
+    stb_vorbis  *vorbis;
+#endif
+};
+
+struct Music_Stream {
+    Music_Source source;
+    AudioStream  stream;
+
+    int16_t      ring[MUSIC_RING_FRAMES * 2];
+    unsigned int ring_read;  // in frames.
+    unsigned int ring_count;
+
+    float gain;        // applied per frame while copying out of the ring.
+    float gain_target;
+    float volume;
+    int   paused;
+
+    // stats.
+    double   decode_seconds;  // time spent decoding.
+    double   decoded_seconds; // music produced.
+    uint32_t loops;
+    uint32_t underruns;
+};
+
+// only 16-bit PCM: anything else should be converted offline (or shipped as .ogg).
+bool music_source_open_wav(Music_Source *src, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+
+    uint8_t riff[12];
+    if (fread(riff, 1, 12, f) != 12 || memcmp(riff, "RIFF", 4) || memcmp(riff + 8, "WAVE", 4)) {
+        fclose(f);
+        return false;
+    }
+
+    uint16_t format = 0, channels = 0, bits = 0;
+    uint32_t rate = 0;
+    for (;;) {
+        uint8_t chunk[8];
+        if (fread(chunk, 1, 8, f) != 8) break;
+
+        uint32_t size;
+        memcpy(&size, chunk + 4, 4);
+
+        if (!memcmp(chunk, "fmt ", 4)) {
+            uint8_t fmt[16];
+            if (size < 16 || fread(fmt, 1, 16, f) != 16) break;
+            memcpy(&format,   fmt + 0,  2);
+            memcpy(&channels, fmt + 2,  2);
+            memcpy(&rate,     fmt + 4,  4);
+            memcpy(&bits,     fmt + 14, 2);
+            fseek(f, size - 16 + (size & 1), SEEK_CUR);
+        }
+        else if (!memcmp(chunk, "data", 4)) {
+            if (format != 1 || bits != 16 || channels < 1 || channels > 2) break;
+
+            src->kind        = MUSIC_SOURCE_WAV;
+            src->sample_rate = rate;
+            src->channels    = channels;
+            src->file        = f;
+            src->data_offset = ftell(f);
+            src->data_frames = size / (channels * 2);
+            src->position    = 0;
+
+            fseek(f, 0, SEEK_END);
+            src->file_size = ftell(f);
+            fseek(f, src->data_offset, SEEK_SET);
+            return true;
+        }
+        else {
+            fseek(f, size + (size & 1), SEEK_CUR);
+        }
+    }
+
+    fclose(f);
+    return false;
+}
+
+bool music_source_open(Music_Source *src, const char *path) {
+    memset(src, 0, sizeof(*src));
+
+#if defined(MUSIC_VORBIS)
+    if (IsFileExtension(path, ".ogg")) {
+        int error = 0;
+        src->vorbis = stb_vorbis_open_filename(path, &error, NULL);
+        if (!src->vorbis) return false;
+
+        stb_vorbis_info info = stb_vorbis_get_info(src->vorbis);
+        src->kind        = MUSIC_SOURCE_VORBIS;
+        src->sample_rate = info.sample_rate;
+        src->channels    = info.channels > 2 ? 2 : info.channels;
+        src->file_size   = GetFileLength(path);
+        return true;
+    }
+#endif
+
+    return music_source_open_wav(src, path);
+}
+
+void music_source_close(Music_Source *src) {
+    if (src->file) fclose(src->file);
+#if defined(MUSIC_VORBIS)
+    if (src->vorbis) stb_vorbis_close(src->vorbis);
+#endif
+    memset(src, 0, sizeof(*src));
+}
+
+//! @return frames read; 0 means the end of the track.
+unsigned int music_source_read(Music_Source *src, int16_t *out, unsigned int frames) {
+    switch(src->kind) {
+        case MUSIC_SOURCE_WAV:
+        {
+            unsigned int left = src->data_frames - src->position;
+            if (frames > left) frames = left;
+
+            // samples are little endian on disk; so is everything we ship on.
+            unsigned int got = fread(out, src->channels * 2, frames, src->file);
+            src->position += got;
+            return got;
+        }
+
+#if defined(MUSIC_VORBIS)
+        case MUSIC_SOURCE_VORBIS:
+            return stb_vorbis_get_samples_short_interleaved(src->vorbis, src->channels, out, frames * src->channels);
+#endif
+    }
+    return 0;
+}
+
+void music_source_rewind(Music_Source *src) {
+    switch(src->kind) {
+        case MUSIC_SOURCE_WAV:
+        {
+            fseek(src->file, src->data_offset, SEEK_SET);
+            src->position = 0;
+        } break;
+
+#if defined(MUSIC_VORBIS)
+        case MUSIC_SOURCE_VORBIS: stb_vorbis_seek_start(src->vorbis); break;
+#endif
+    }
+}
+
+// fills the ring as far as it goes.
+void music_stream_decode_ahead(Music_Stream *m) {
+    unsigned int channels = m->source.channels;
+    auto begin = std::chrono::steady_clock::now();
+    unsigned int produced = 0;
+
+    while (MUSIC_RING_FRAMES - m->ring_count >= MUSIC_DECODE_FRAMES) {
+        unsigned int write  = (m->ring_read + m->ring_count) % MUSIC_RING_FRAMES;
+        unsigned int frames = MUSIC_DECODE_FRAMES;
+        if (write + frames > MUSIC_RING_FRAMES) frames = MUSIC_RING_FRAMES - write;
+
+        unsigned int got = music_source_read(&m->source, m->ring + write * channels, frames);
+        if (got == 0) {
+            // end of the track: the next frame in the ring is frame 0.
+            music_source_rewind(&m->source);
+            m->loops += 1;
+
+            got = music_source_read(&m->source, m->ring + write * channels, frames);
+            if (got == 0) break; // empty or broken file.
+        }
+
+        m->ring_count += got;
+        produced      += got;
+    }
+
+    if (produced) {
+        m->decode_seconds  += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        m->decoded_seconds += (double)produced / m->source.sample_rate;
+    }
+}
+
+// call on the main thread, after music_source_open().
+void music_stream_create(Music_Stream *m) {
+    SetAudioStreamBufferSizeDefault(MUSIC_UPDATE_FRAMES);
+    m->stream = LoadAudioStream(m->source.sample_rate, 16, m->source.channels);
+    SetAudioStreamBufferSizeDefault(0);
+
+    m->ring_read   = 0;
+    m->ring_count  = 0;
+    m->gain        = 0.0;
+    m->gain_target = 0.0;
+    m->volume      = 1.0;
+    m->paused      = 1;
+}
+
+void music_stream_destroy(Music_Stream *m) {
+    UnloadAudioStream(m->stream);
+    music_source_close(&m->source);
+}
+
+void music_stream_fade(Music_Stream *m, float target) {
+    m->gain_target = target;
+    if (target > 0.0 && m->paused) {
+        m->paused = 0;
+        ResumeAudioStream(m->stream);
+    }
+}
+
+// audio thread: decode ahead, refill whatever raylib has consumed.
+void music_stream_update(Music_Stream *m) {
+    music_stream_decode_ahead(m);
+    if (m->paused) return;
+
+    unsigned int channels = m->source.channels;
+    float step = 1.0 / (MUSIC_FADE_SECONDS * m->source.sample_rate);
+
+    // at most both sub-buffers per update.
+    for (int refill = 0; refill < 2 && IsAudioStreamProcessed(m->stream); ++refill) {
+        int16_t out[MUSIC_UPDATE_FRAMES * 2];
+
+        for (int i = 0; i < MUSIC_UPDATE_FRAMES; ++i) {
+            if      (m->gain < m->gain_target) m->gain = fmin(m->gain + step, m->gain_target);
+            else if (m->gain > m->gain_target) m->gain = fmax(m->gain - step, m->gain_target);
+
+            if (m->ring_count == 0) {
+                m->underruns += (i == 0);
+                for (unsigned int c = 0; c < channels; ++c) out[i * channels + c] = 0;
+                continue;
+            }
+
+            int16_t *frame = m->ring + m->ring_read * channels;
+            for (unsigned int c = 0; c < channels; ++c) {
+                out[i * channels + c] = (int16_t)(frame[c] * m->gain);
+            }
+            m->ring_read   = (m->ring_read + 1) % MUSIC_RING_FRAMES;
+            m->ring_count -= 1;
+        }
+
+        UpdateAudioStream(m->stream, out, MUSIC_UPDATE_FRAMES);
+        music_stream_decode_ahead(m);
+    }
+
+    // faded all the way out: stop eating the ring until someone fades back in.
+    if (m->gain == 0.0 && m->gain_target == 0.0) {
+        m->paused = 1;
+        PauseAudioStream(m->stream);
+    }
+}
+
+void music_stream_report(Music_Stream *m, FILE *out) {
+    size_t ring_bytes   = sizeof(m->ring);
+    size_t device_bytes = MUSIC_UPDATE_FRAMES * 2 * m->source.channels * sizeof(int16_t);
+    double cpu_per_sec  = m->decoded_seconds > 0 ? m->decode_seconds / m->decoded_seconds : 0;
+
+    fprintf(out, "[music] %u Hz, %u ch, %.1f KB on disk\n", m->source.sample_rate, m->source.channels, m->source.file_size / 1024.0);
+    fprintf(out, "[music] memory: ring %.1f KB + device %.1f KB\n", ring_bytes / 1024.0, device_bytes / 1024.0);
+    fprintf(out, "[music] decoded %.1f s in %.2f ms (%.3f ms per second of music), %u loops, %u underruns\n",
+            m->decoded_seconds, m->decode_seconds * 1000.0, cpu_per_sec * 1000.0, m->loops, m->underruns);
+}
+
+// ===================================
+// Assets.
+// everything is listed up front (asset_add), checked for existence right away,
+// then decoded on worker threads in priority order: file reads, wave decoding
+// and glyph rasterization all happen off the main thread. whatever needs the
+// GL context or the audio device (texture upload, sound buffers, music streams)
+// is finished on the main thread by assets_pump(), fed through one completion
+// queue per worker. until an asset is ready its bound pointer stays NULL, and
+// the game runs without it (default font, no sound).
+#define MAX_ASSETS    16
+#define ASSET_WORKERS 2
+
+enum {
+    ASSET_SOUND,
+    ASSET_MUSIC,
+    ASSET_FONT,
+};
+
+enum {
+    ASSET_QUEUED,
+    ASSET_DECODING,
+    ASSET_DECODED,  // worker is done; waiting for the main thread.
+    ASSET_READY,
+    ASSET_MISSING,
+    ASSET_FAILED,
+};
+
+typedef int Asset_Handle;
+
+struct Asset {
+    int         kind;
+    const char *path;
+    int         priority;  // lower loads first.
+    int         font_size;
+    void      **bind;      // gets pointed at the loaded object once it's ready.
+
+    std::atomic<int> state;
+
+    // worker output.
+    Wave       wave;
+    GlyphInfo *glyphs;
+    Rectangle *recs;
+    Image      atlas;
+
+    // final objects.
+    Sound        sound;
+    Music_Stream music;
+    Font         font;
+};
+
+struct Asset_Manager {
+    Asset assets[MAX_ASSETS];
+    int   count;
+
+    int order[MAX_ASSETS]; // asset indices, by priority.
+    std::atomic<int> next; // next position in order[] a worker picks up.
+
+    std::thread workers[ASSET_WORKERS];
+    fz_SPSC_Queue<int, MAX_ASSETS> done[ASSET_WORKERS];
+    int pending; // queued + in flight; main thread only.
+};
+
+static Asset_Manager asset_manager;
+
+Asset_Handle asset_add(int kind, const char *path, int priority, void **bind, int font_size = 0) {
+    Asset_Manager *m = &asset_manager;
+    assert(m->count < MAX_ASSETS);
+
+    Asset_Handle handle = m->count++;
+    Asset *a = &m->assets[handle];
+    a->kind      = kind;
+    a->path      = path;
+    a->priority  = priority;
+    a->bind      = bind;
+    a->font_size = font_size;
+    a->state     = ASSET_QUEUED;
+    return handle;
+}
+
+inline bool asset_ready(Asset_Handle handle) {
+    return asset_manager.assets[handle].state.load(std::memory_order_acquire) == ASSET_READY;
+}
+
+void asset_decode(Asset *a) {
+    switch(a->kind) {
+        case ASSET_SOUND:
+        {
+            a->wave = LoadWave(a->path);
+            if (!a->wave.data) a->state = ASSET_FAILED;
+        } break;
+
+        case ASSET_FONT:
+        {
+            unsigned int size = 0;
+            unsigned char *data = LoadFileData(a->path, &size);
+            if (!data) { a->state = ASSET_FAILED; break; }
+
+            a->glyphs = LoadFontData(data, size, a->font_size, 0, 95, FONT_DEFAULT);
+            if (a->glyphs) a->atlas = GenImageFontAtlas(a->glyphs, &a->recs, 95, a->font_size, 4, 0);
+            else           a->state = ASSET_FAILED;
+            UnloadFileData(data);
+        } break;
+
+        // the header parse happens here; the device stream is made on the main thread.
+        case ASSET_MUSIC:
+        {
+            if (!music_source_open(&a->music.source, a->path)) a->state = ASSET_FAILED;
+        } break;
+    }
+}
+
+void asset_worker_main(int worker) {
+    Asset_Manager *m = &asset_manager;
+    for (;;) {
+        int slot = m->next.fetch_add(1);
+        if (slot >= m->count) break;
+
+        int index = m->order[slot];
+        Asset *a = &m->assets[index];
+        if (a->state.load() == ASSET_MISSING) continue;
+
+        a->state = ASSET_DECODING;
+        asset_decode(a);
+        if (a->state.load() == ASSET_DECODING) a->state = ASSET_DECODED;
+
+        m->done[worker].push(index);
+    }
+}
+
+// checks every file, reports all the missing ones at once, and starts the workers.
+//! @return number of missing assets.
+int assets_begin() {
+    Asset_Manager *m = &asset_manager;
+    int missing = 0;
+
+    for (int i = 0; i < m->count; ++i) {
+        m->order[i] = i;
+        if (!FileExists(m->assets[i].path)) {
+            fprintf(stderr, "[assets] missing: %s\n", m->assets[i].path);
+            m->assets[i].state = ASSET_MISSING;
+            missing += 1;
+        }
+    }
+
+    fz_sort(m->order, m->count, [m](int a, int b) { return m->assets[a].priority < m->assets[b].priority; });
+
+    m->pending = m->count - missing;
+    m->next    = 0;
+    for (int i = 0; i < ASSET_WORKERS; ++i) {
+        m->workers[i] = std::thread(asset_worker_main, i);
+    }
+    return missing;
+}
+
+// main thread: finishes decoded assets. cheap when there's nothing to do.
+void assets_pump() {
+    Asset_Manager *m = &asset_manager;
+    if (m->pending == 0) return;
+
+    for (int w = 0; w < ASSET_WORKERS; ++w) {
+        int index;
+        while (m->done[w].pop(&index)) {
+            Asset *a = &m->assets[index];
+            m->pending -= 1;
+            if (a->state.load() != ASSET_DECODED) continue;
+
+            switch(a->kind) {
+                case ASSET_SOUND:
+                {
+                    a->sound = LoadSoundFromWave(a->wave);
+                    UnloadWave(a->wave);
+                    if (a->bind) *a->bind = &a->sound;
+                } break;
+
+                case ASSET_MUSIC:
+                {
+                    music_stream_create(&a->music);
+                    if (a->bind) *a->bind = &a->music;
+                } break;
+
+                case ASSET_FONT:
+                {
+                    a->font.baseSize     = a->font_size;
+                    a->font.glyphCount   = 95;
+                    a->font.glyphPadding = 4;
+                    a->font.glyphs       = a->glyphs;
+                    a->font.recs         = a->recs;
+                    if (!headless) a->font.texture = LoadTextureFromImage(a->atlas);
+                    UnloadImage(a->atlas);
+                    if (a->bind) *a->bind = &a->font;
+                } break;
+            }
+            a->state.store(ASSET_READY, std::memory_order_release);
+        }
+    }
+
+    if (m->pending == 0) {
+        for (int i = 0; i < ASSET_WORKERS; ++i) m->workers[i].join();
+    }
+}
+
+// blocks until this one asset has landed, loaded or not.
+void asset_wait(Asset_Handle handle) {
+    for (;;) {
+        int state = asset_manager.assets[handle].state.load(std::memory_order_acquire);
+        if (state == ASSET_READY || state == ASSET_MISSING || state == ASSET_FAILED) return;
+        assets_pump();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// blocks until everything that was going to load has.
+void assets_wait() {
+    while (asset_manager.pending > 0) {
+        assets_pump();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void assets_end() {
+    Asset_Manager *m = &asset_manager;
+
+    // anything still in flight has to land before it can be freed.
+    assets_wait();
+
+    // with nothing to load, pending started at 0 and assets_pump never joined them.
+    for (int i = 0; i < ASSET_WORKERS; ++i) {
+        if (m->workers[i].joinable()) m->workers[i].join();
+    }
+
+    for (int i = 0; i < m->count; ++i) {
+        Asset *a = &m->assets[i];
+        if (a->state.load() != ASSET_READY) continue;
+        if (a->bind) *a->bind = NULL;
+
+        switch(a->kind) {
+            case ASSET_SOUND: UnloadSound(a->sound);       break;
+            case ASSET_MUSIC: music_stream_destroy(&a->music); break;
+            case ASSET_FONT:
+            {
+                // headless fonts never got a texture; UnloadFont would try to free one.
+                if (a->font.texture.id) {
+                    UnloadFont(a->font);
+                } else {
+                    UnloadFontData(a->font.glyphs, a->font.glyphCount);
+                    MemFree(a->font.recs);
+                }
+            } break;
+        }
+    }
+}
+
+// MeasureTextEx from the glyph metrics alone: raylib's gives up on fonts without a texture.
+Vector2 measure_glyphs(const Font *font, const char *text, float size, float spacing) {
+    if (!font || !font->glyphs) return { 0, 0 };
+
+    float scale = size / font->baseSize;
+    float width = 0, line = 0, lines = 1;
+    int   count = 0;
+    for (const char *c = text; *c; ++c) {
+        if (*c == '\n') {
+            width = fmaxf(width, line);
+            line  = 0;
+            lines += 1.5f;
+            continue;
+        }
+
+        int index = (*c >= 32 && *c < 32 + font->glyphCount) ? *c - 32 : '?' - 32;
+        const GlyphInfo *g = &font->glyphs[index];
+        line  += g->advanceX ? g->advanceX : font->recs[index].width + g->offsetX;
+        count += 1;
+    }
+    width = fmaxf(width, line);
+
+    return { width * scale + (count > 0 ? (count - 1) * spacing : 0), lines * font->baseSize * scale };
+}
+
+// MeasureTextEx, falling back to the default font like push_text does.
+// headless has no default font (it's a texture); main_font stands in for it.
+inline Vector2 measure_text(Font *font, const char *text, float size) {
+    if (headless) return font ? measure_glyphs(font, text, size, 0) : measure_glyphs(main_font, text, size, size / 10);
+    if (font) return MeasureTextEx(*font, text, size, 0);
+    return MeasureTextEx(GetFontDefault(), text, size, size / 10);
+}
+
+// ===================================
+// Audio thread.
+// the game thread never touches the audio device after startup: it pushes
+// fire-and-forget commands, and the audio thread plays them and keeps the
+// music streamer (see Music_Stream) decoded ahead and fed. a slow refill can't stall a tick anymore.
+#define AUDIO_QUEUE_SIZE  256
+#define AUDIO_PERIOD_MS   4
+
+enum {
+    AUDIO_PLAY,          // sound
+    AUDIO_STOP,          // sound
+    AUDIO_SOUND_PITCH,   // sound, value
+    AUDIO_SOUND_VOLUME,  // sound, value
+    AUDIO_MUSIC_BIND,    // music
+    AUDIO_MUSIC_FADE,    // value: target gain. at 0 the stream pauses once the fade is done.
+    AUDIO_MUSIC_VOLUME,  // value
+};
+
+struct Audio_Command {
+    int   type;
+    float value;
+    union {
+        Sound        *sound;
+        Music_Stream *music;
+    };
+};
+
+struct Audio {
+    fz_SPSC_Queue<Audio_Command, AUDIO_QUEUE_SIZE> queue;
+    std::thread           thread;
+    std::atomic<bool>     running;
+    std::atomic<uint32_t> dropped;
+
+    // audio thread only.
+    Music_Stream *music;
+    float         music_target; // kept for a stream that gets bound later.
+
+    // game thread only.
+    Music_Stream *bound_music;
+    int           bound_fade;
+};
+
+static Audio audio;
+
+void audio_run_command(Audio *a, Audio_Command *cmd) {
+    switch(cmd->type) {
+        case AUDIO_PLAY:         PlaySoundMulti(*cmd->sound);               break;
+        case AUDIO_STOP:         StopSound(*cmd->sound);                    break;
+        case AUDIO_SOUND_PITCH:  SetSoundPitch(*cmd->sound, cmd->value);    break;
+        case AUDIO_SOUND_VOLUME: SetSoundVolume(*cmd->sound, cmd->value);   break;
+
+        case AUDIO_MUSIC_BIND:
+        {
+            a->music = cmd->music;
+            music_stream_decode_ahead(a->music);
+            PlayAudioStream(a->music->stream);
+            PauseAudioStream(a->music->stream);
+            music_stream_fade(a->music, a->music_target);
+        } break;
+
+        case AUDIO_MUSIC_FADE:
+        {
+            a->music_target = cmd->value;
+            if (a->music) music_stream_fade(a->music, a->music_target);
+        } break;
+
+        case AUDIO_MUSIC_VOLUME:
+        {
+            if (a->music) SetAudioStreamVolume(a->music->stream, cmd->value);
+        } break;
+    }
+}
+
+void audio_thread_main(Audio *a) {
+    for (;;) {
+        bool running = a->running.load(std::memory_order_acquire);
+
+        Audio_Command cmd;
+        while (a->queue.pop(&cmd)) {
+            audio_run_command(a, &cmd);
+        }
+        if (!running) break;
+
+        if (a->music) music_stream_update(a->music);
+        std::this_thread::sleep_for(std::chrono::milliseconds(AUDIO_PERIOD_MS));
+    }
+}
+
+// call after InitAudioDevice().
+void audio_start(Audio *a) {
+    a->music        = NULL;
+    a->music_target = 0.0;
+    a->bound_music  = NULL;
+    a->bound_fade   = -1;
+    a->dropped      = 0;
+    a->running      = true;
+    a->thread = std::thread(audio_thread_main, a);
+}
+
+// call before anything the audio thread might be using gets unloaded.
+void audio_stop(Audio *a) {
+    if (!a->running) return;
+    a->running.store(false, std::memory_order_release);
+    a->thread.join();
+
+    if (a->music) music_stream_report(a->music, stderr);
+    a->music = NULL;
+
+    if (a->dropped) {
+        fprintf(stderr, "[audio] dropped %u commands\n", a->dropped.load());
+    }
+}
+
+void audio_push(int type, void *target, float value = 0.0) {
+    Audio_Command cmd;
+    cmd.type  = type;
+    cmd.value = value;
+    cmd.sound = (Sound *)target;
+    if (!audio.queue.push(cmd)) audio.dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void audio_play(Sound *sound) {
+    if (sound) audio_push(AUDIO_PLAY, sound);
+}
+
+// ===================================
+// Game events.
+// the simulation doesn't touch audio, the camera or the score directly;
+// it writes events here during the tick, and drain_events() applies them
+// in one batch at the end of game_update().
+enum {
+    EVENT_SOUND,        // play `sound`. coalesced: at most once per sound per tick.
+    EVENT_SHAKE,        // camerashake += amount.
+    EVENT_SHAKE_SET,    // camerashake  = amount.
+    EVENT_CAPTURE,      // captured enemy died: `points` go into the combo.
+    EVENT_COMBO_END,    // combo ran out: bank it into the score.
+    EVENT_PLAYER_DIED,  // coalesced: only the first one in a tick counts.
+    EVENT_SPAWNED,      // an enemy appeared at `pos`.
+    EVENT_EFFECT,       // cosmetic `effect` at `pos`, facing `dir`.
+};
+
+struct Game_Event {
+    int type;
+    union {
+        int   sound;
+        float amount;
+        int   points;
+        int   effect;
+    };
+    Vector2 pos;
+    Vector2 dir;
+};
+
+typedef fz_Array<Game_Event, 0, fz_Arena_Policy> Event_Queue;
+
+// only valid inside game_update(); lives in the frame arena.
+static Event_Queue *tick_events;
+
+// fast-forwarding / headless runs leave this off.
+static int events_play_audio = 1;
+
+inline void emit_event(int type) {
+    assert(tick_events && "events can only be emitted during game_update().");
+    Game_Event *ev = &tick_events->push({});
+    ev->type = type;
+}
+
+inline void emit_sound(int sound) {
+    emit_event(EVENT_SOUND);
+    tick_events->last().sound = sound;
+}
+
+inline void emit_shake(float amount) {
+    emit_event(EVENT_SHAKE);
+    tick_events->last().amount = amount;
+}
+
+inline void emit_shake_set(float amount) {
+    emit_event(EVENT_SHAKE_SET);
+    tick_events->last().amount = amount;
+}
+
+inline void emit_capture(int points, Vector2 pos) {
+    emit_event(EVENT_CAPTURE);
+    tick_events->last().points = points;
+    tick_events->last().pos    = pos;
+}
+
+inline void emit_spawned(Vector2 pos) {
+    emit_event(EVENT_SPAWNED);
+    tick_events->last().pos = pos;
+}
+
+inline void emit_effect(int effect, Vector2 pos, Vector2 dir = { 0, -1 }) {
+    emit_event(EVENT_EFFECT);
+    tick_events->last().effect = effect;
+    tick_events->last().pos    = pos;
+    tick_events->last().dir    = dir;
+}
+
+// ===================================
+// Snapshot ring.
+// every tick the Sim_State is diffed against the previous one (fz_delta_capture)
+// and only the XOR of the changed words is kept. since XOR undoes itself,
+// walking the deltas backwards from `head` restores any of the last
+// SNAPSHOT_SECONDS without ever storing a full copy per tick.
+#define SNAPSHOT_SECONDS 10
+#define SNAPSHOT_TICKS   ((int)(SNAPSHOT_SECONDS / 0.016))
+#define SNAPSHOT_BYTES   (8 * fz_MB)
+
+struct Snapshot_Record {
+    size_t offset;
+    size_t size;
+};
+
+struct Snapshot_Ring {
+    Sim_State head; // the newest captured state.
+
+    // record i takes state i-1 to state i (and back).
+    Snapshot_Record records[SNAPSHOT_TICKS];
+    int             first;
+    int             count;
+
+    uint8_t *bytes;
+    size_t   bytes_caps;
+    size_t   write;
+};
+
+static Snapshot_Ring snapshots;
+
+// the byte ring gets written across every tick: huge pages, where there are any,
+// keep it to a handful of TLB entries.
+static fz_Arena snapshot_arena;
+
+void *snapshot_memory() {
+    arena_reserve(&snapshot_arena, SNAPSHOT_BYTES, fz_PAGES_HUGE, "snapshot");
+    return fz_alloc_ex(fz_arena_allocator(&snapshot_arena), SNAPSHOT_BYTES);
+}
+
+// forgets all history; the current sim becomes the head.
+void snapshot_reset(Snapshot_Ring *ring) {
+    ring->write = 0;
+    ring->first = 0;
+    ring->count = 0;
+    ring->head  = sim;
+}
+
+void snapshot_init(Snapshot_Ring *ring, void *backing, size_t size) {
+    ring->bytes      = (uint8_t *)backing;
+    ring->bytes_caps = size;
+    snapshot_reset(ring);
+}
+
+inline Snapshot_Record *snapshot_record(Snapshot_Ring *ring, int age_order) {
+    return &ring->records[(ring->first + age_order) % SNAPSHOT_TICKS];
+}
+
+void snapshot_drop_oldest(Snapshot_Ring *ring, int n) {
+    ring->first  = (ring->first + n) % SNAPSHOT_TICKS;
+    ring->count -= n;
+}
+
+void snapshot_capture(Snapshot_Ring *ring, const Sim_State *state) {
+    size_t bound = fz_delta_bound(sizeof(Sim_State));
+    uint8_t *delta = (uint8_t *)fz_alloc_ex(frame_allocator(), bound);
+    size_t size = fz_delta_capture(&ring->head, state, sizeof(Sim_State), delta, bound);
+
+    if (ring->write + size > ring->bytes_caps) ring->write = 0;
+    size_t begin = ring->write;
+    size_t end   = begin + size;
+
+    // the delta chain only works front to back: if any record is in the way,
+    // it goes along with everything older than it.
+    int overwritten = 0;
+    for (int i = 0; i < ring->count; ++i) {
+        Snapshot_Record *r = snapshot_record(ring, i);
+        if (r->offset < end && begin < r->offset + r->size) overwritten = i + 1;
+    }
+    if (ring->count == SNAPSHOT_TICKS && overwritten == 0) overwritten = 1;
+    snapshot_drop_oldest(ring, overwritten);
+
+    memcpy(ring->bytes + begin, delta, size);
+    ring->write = end;
+
+    Snapshot_Record *r = snapshot_record(ring, ring->count++);
+    r->offset = begin;
+    r->size   = size;
+}
+
+// puts the state from `ticks_ago` ticks back into `out`. head itself is 0 ticks ago.
+//! @return how many ticks it actually went back (limited by the history there is).
+int snapshot_peek(Snapshot_Ring *ring, int ticks_ago, Sim_State *out) {
+    if (ticks_ago > ring->count) ticks_ago = ring->count;
+
+    *out = ring->head;
+    for (int i = 0; i < ticks_ago; ++i) {
+        Snapshot_Record *r = snapshot_record(ring, ring->count - 1 - i);
+        fz_delta_apply(out, sizeof(Sim_State), ring->bytes + r->offset, r->size);
+    }
+    return ticks_ago;
+}
+
+// rolls the game back, and forgets the future that was rolled over.
+int snapshot_restore(Snapshot_Ring *ring, int ticks_ago) {
+    ticks_ago = snapshot_peek(ring, ticks_ago, &ring->head);
+    ring->count -= ticks_ago;
+    if (ring->count > 0) {
+        Snapshot_Record *newest = snapshot_record(ring, ring->count - 1);
+        ring->write = newest->offset + newest->size;
+    }
+
+    sim = ring->head;
+    return ticks_ago;
+}
+
+// ===================================
+// Save states.
+// one flat, versioned block: header, then sections at 16 byte aligned offsets.
+// loading maps the file and points straight into it (Save_View) -- nothing is
+// parsed field by field. native endianness; any layout change bumps SAVE_VERSION.
+#define SAVE_MAGIC   0x56534C4Du // "MLSV"
+#if defined(SIM_FIXED_POINT)
+#define SAVE_VERSION 0x10008 // same sizes as a float build, different bits: never mix them.
+#else
+#define SAVE_VERSION 8
+#endif
+#define SAVE_ALIGN   16
+
+struct Save_Section {
+    uint32_t offset; // from the start of the file.
+    uint32_t stride; // sizeof one element; checked on load.
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct Save_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t checksum; // fz_fnv1a_32 of everything after the header.
+    uint32_t level;    // Level::hash: surfaces and walls are indices into it.
+
+    Save_Section game;
+    Save_Section player;
+    Save_Section misc;
+    Save_Section entities;     // the live ones, in sim.entities order.
+    Save_Section entity_slots; // as many as were ever handed out.
+};
+
+// the rest of Sim_State.
+struct Save_Misc {
+    Camera2D camera;
+    Sim_Real accel;
+    Sim_Real timer_carry;
+    fz_Rng   rng;
+    fz_Timing_Wheel<SIM_TIMERS> timers;
+    int32_t  entity_free_slot;
+};
+
+struct Save_View {
+    const Save_Header *header;
+    const Game        *game;
+    const Player      *player;
+    const Save_Misc   *misc;
+    const Entity      *entities;
+    int                entity_count;
+    const Entity_Slot *entity_slots;
+    int                entity_slot_count;
+};
+
+inline uint32_t save_place(uint32_t *cursor, Save_Section *section, uint32_t stride, uint32_t count) {
+    *cursor = (uint32_t)fz_align_to_power_of_two(*cursor, SAVE_ALIGN);
+    section->offset   = *cursor;
+    section->stride   = stride;
+    section->count    = count;
+    section->reserved = 0;
+    *cursor += stride * count;
+    return section->offset;
+}
+
+//! serializes the current sim into the frame arena.
+//! @return pointer to the block, and its size in *size.
+uint8_t *savestate_build(size_t *size) {
+    Save_Header header = {0};
+    header.magic   = SAVE_MAGIC;
+    header.version = SAVE_VERSION;
+    header.level   = level.hash;
+
+    uint32_t cursor = sizeof(Save_Header);
+    save_place(&cursor, &header.game,     sizeof(Game),        1);
+    save_place(&cursor, &header.player,   sizeof(Player),      1);
+    save_place(&cursor, &header.misc,     sizeof(Save_Misc),   1);
+    save_place(&cursor, &header.entities,     sizeof(Entity),      sim.entity_count);
+    save_place(&cursor, &header.entity_slots, sizeof(Entity_Slot), sim.entity_slot_count);
+    header.total_size = cursor;
+
+    uint8_t *block = (uint8_t *)fz_alloc_ex(frame_allocator(), cursor);
+    memset(block, 0, cursor);
+
+    memcpy(block + header.game.offset,   &sim.game,   sizeof(Game));
+    memcpy(block + header.player.offset, &sim.player, sizeof(Player));
+
+    Save_Misc *misc = (Save_Misc *)(block + header.misc.offset);
+    misc->camera               = sim.camera;
+    misc->timers               = sim.timers;
+    misc->timer_carry          = sim.timer_carry;
+    misc->rng                  = sim.rng;
+    misc->accel                = sim.accel;
+    misc->entity_free_slot     = sim.entity_free_slot;
+
+    memcpy(block + header.entities.offset,     sim.entities,     sizeof(Entity)      * sim.entity_count);
+    memcpy(block + header.entity_slots.offset, sim.entity_slots, sizeof(Entity_Slot) * sim.entity_slot_count);
+
+    header.checksum = fz_fnv1a_32(block + sizeof(Save_Header), cursor - sizeof(Save_Header));
+    memcpy(block, &header, sizeof(header));
+
+    *size = cursor;
+    return block;
+}
+
+inline bool save_section_ok(const Save_Section *s, uint32_t stride, uint32_t total) {
+    if (s->stride != stride) return false;
+    if (s->offset % SAVE_ALIGN) return false;
+    return (uint64_t)s->offset + (uint64_t)s->stride * s->count <= total;
+}
+
+//! validates a save state in memory and points a view into it. no copies.
+bool savestate_open(const void *data, size_t size, Save_View *view) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    const Save_Header *header = (const Save_Header *)data;
+
+    if (size < sizeof(Save_Header))               return false;
+    if (header->magic   != SAVE_MAGIC)            return false;
+    if (header->version != SAVE_VERSION)          return false;
+    if (header->total_size != size)               return false;
+    if (header->level   != level.hash)            return false;
+
+    if (!save_section_ok(&header->game,     sizeof(Game),        size) || header->game.count   != 1) return false;
+    if (!save_section_ok(&header->player,   sizeof(Player),      size) || header->player.count != 1) return false;
+    if (!save_section_ok(&header->misc,     sizeof(Save_Misc),   size) || header->misc.count   != 1) return false;
+    if (!save_section_ok(&header->entities,     sizeof(Entity),      size) || header->entities.count     > MAX_ENTITIES) return false;
+    if (!save_section_ok(&header->entity_slots, sizeof(Entity_Slot), size) || header->entity_slots.count > MAX_ENTITIES) return false;
+    if (header->checksum != fz_fnv1a_32(bytes + sizeof(Save_Header), size - sizeof(Save_Header))) return false;
+
+    view->header            = header;
+    view->game              = (const Game *)(bytes + header->game.offset);
+    view->player            = (const Player *)(bytes + header->player.offset);
+    view->misc              = (const Save_Misc *)(bytes + header->misc.offset);
+    view->entities          = (const Entity *)(bytes + header->entities.offset);
+    view->entity_count      = header->entities.count;
+    view->entity_slots      = (const Entity_Slot *)(bytes + header->entity_slots.offset);
+    view->entity_slot_count = header->entity_slots.count;
+
+    // every slot handed out is either one live entity's or on the free chain, once.
+    // 1: live, 2: free.
+    uint8_t seen[MAX_ENTITIES] = {};
+
+    // every live entity's handle has to lead back to it, at the slot's generation.
+    for (int i = 0; i < view->entity_count; ++i) {
+        Entity_Handle handle = view->entities[i].handle;
+        int slot = entity_slot_of(handle);
+        if (slot < 0 || slot >= view->entity_slot_count)           return false;
+        if (seen[slot])                                            return false;
+        if (view->entity_slots[slot].dense != i)                   return false;
+        if (view->entity_slots[slot].generation != (handle >> 16)) return false;
+        seen[slot] = 1;
+    }
+
+    // the free chain: in range, no slot twice (which also rules out a loop), and
+    // with the live ones it covers everything. spawn_entity() trusts all of it.
+    int free_count = 0;
+    for (int next = view->misc->entity_free_slot; next != 0; ) {
+        int slot = next - 1;
+        if (slot < 0 || slot >= view->entity_slot_count) return false;
+        if (seen[slot])                                   return false;
+        seen[slot] = 2;
+        free_count += 1;
+        next = view->entity_slots[slot].dense;
+    }
+    if (view->entity_count + free_count != view->entity_slot_count) return false;
+
+    // the wheel gets copied in whole, so its lists have to hold up on their own...
+    const fz_Timing_Wheel<SIM_TIMERS> *timers = &view->misc->timers;
+    if (!timers->valid()) return false;
+
+    // ...and every pending timer and the entity it's for have to point at each other.
+    for (uint16_t i = 0; i < timers->fresh; ++i) {
+        if (timers->nodes[i].slot == fz_WHEEL_NIL) continue;
+
+        int kind = timers->nodes[i].kind;
+        if (kind == TIMER_ENEMY_SPAWN) continue;
+        if (kind != TIMER_ENEMY_FIRE && kind != TIMER_DEATH_EXPIRE) return false;
+
+        Entity_Handle user = timers->nodes[i].user;
+        int slot = entity_slot_of(user);
+        if (slot < 0 || slot >= view->entity_slot_count || seen[slot] != 1) return false;
+
+        const Entity *e = &view->entities[view->entity_slots[slot].dense];
+        if (e->handle != user || e->timer != timers->handle_of(i))        return false;
+        if (e->type != (kind == TIMER_ENEMY_FIRE ? ENTITY_ENEMY : ENTITY_DEATH)) return false;
+    }
+
+    for (int i = 0; i < view->entity_count; ++i) {
+        fz_Timer_Handle handle = view->entities[i].timer;
+        if (handle == 0) continue;
+
+        const fz_Timing_Wheel<SIM_TIMERS>::Node *n = timers->lookup(handle);
+        if (!n || n->user != view->entities[i].handle) return false;
+    }
+    return true;
+}
+
+void savestate_apply(const Save_View *view) {
+    sim.game   = *view->game;
+    sim.player = *view->player;
+
+    sim.camera               = view->misc->camera;
+    sim.timers               = view->misc->timers;
+    sim.timer_carry          = view->misc->timer_carry;
+    sim.rng                  = view->misc->rng;
+    sim.accel                = view->misc->accel;
+
+    memset(sim.entities,     0, sizeof(sim.entities));
+    memset(sim.entity_slots, 0, sizeof(sim.entity_slots));
+    memcpy(sim.entities,     view->entities,     sizeof(Entity)      * view->entity_count);
+    memcpy(sim.entity_slots, view->entity_slots, sizeof(Entity_Slot) * view->entity_slot_count);
+    sim.entity_count      = view->entity_count;
+    sim.entity_slot_count = view->entity_slot_count;
+    sim.entity_free_slot  = view->misc->entity_free_slot;
+
+    // the rewind history belongs to a different timeline now.
+    snapshot_reset(&snapshots);
+}
+
+bool savestate_write(const char *path) {
+    fz_Temp_Block scratch(frame_arena());
+
+    size_t size;
+    uint8_t *block = savestate_build(&size);
+
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+    size_t written = fwrite(block, 1, size, file);
+    fclose(file);
+
+    return written == size;
+}
+
+bool savestate_load(const char *path) {
+    fz_File_Map map = fz_file_map(path);
+    if (!map.data) return false;
+
+    Save_View view;
+    bool ok = savestate_open(map.data, map.size, &view);
+    if (ok) savestate_apply(&view);
+
+    fz_file_unmap(&map);
+    return ok;
+}
+
+// ===================================
+// Telemetry.
+// per-tick and per-event records for offline analysis. the game thread only pushes
+// into a lock-free queue; a writer thread drains it to disk, so a slow disk can
+// never stall a fixed update. when the queue is full, records are dropped and counted.
+// enabled with --telemetry <file>; a .csv extension writes CSV, anything else binary.
+enum {
+    TELEMETRY_TICK,         // i0: state,  i1: live entities, f0: tick duration (ms)
+    TELEMETRY_CAPTURE,      // i0: combo,  i1: kills this run, f0/f1: position
+    TELEMETRY_COMBO_BREAK,  // i0: combo,  i1: score banked
+    TELEMETRY_HIT,          // i0: score,  i1: kills this run, f0: seconds alive
+    TELEMETRY_SPAWN,        // i0: entity type,                f0/f1: position
+    TELEMETRY_INPUT_LATENCY, //                                 f0: sample -> present (ms), f1: upper bound (ms)
+};
+
+struct Telemetry_Record {
+    uint32_t tick;
+    uint32_t type;
+    int32_t  i0;
+    int32_t  i1;
+    float    f0;
+    float    f1;
+};
+
+#define TELEMETRY_MAGIC   0x4D544C4Du // "MLTM"
+#define TELEMETRY_VERSION 1
+
+// binary files start with this, then records back to back.
+struct Telemetry_File_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    float    tick_dt;
+};
+
+struct Telemetry {
+    fz_SPSC_Queue<Telemetry_Record, 16384> queue;
+
+    std::thread       writer;
+    std::atomic<bool> running;
+    std::atomic<uint32_t> dropped;
+
+    FILE *file;
+    int   csv;
+    int   enabled;
+};
+
+static Telemetry telemetry;
+
+void telemetry_write(Telemetry *t, const Telemetry_Record *r) {
+    if (t->csv) {
+        static const char *names[] = { "tick", "capture", "combo_break", "hit", "spawn", "input_latency" };
+        fprintf(t->file, "%u,%s,%d,%d,%g,%g\n", r->tick, names[r->type], r->i0, r->i1, r->f0, r->f1);
+    } else {
+        fwrite(r, sizeof(*r), 1, t->file);
+    }
+}
+
+void telemetry_writer_main(Telemetry *t) {
+    Telemetry_Record r;
+    for (;;) {
+        bool stopping = !t->running.load(std::memory_order_acquire);
+
+        int written = 0;
+        while (t->queue.pop(&r)) {
+            telemetry_write(t, &r);
+            written += 1;
+        }
+
+        if (stopping) break;
+        if (!written) std::this_thread::sleep_for(std::chrono::milliseconds(4));
+    }
+    fflush(t->file);
+}
+
+bool telemetry_start(Telemetry *t, const char *path) {
+    t->file = fopen(path, "wb");
+    if (!t->file) return false;
+
+    size_t length = strlen(path);
+    t->csv = length > 4 && strcmp(path + length - 4, ".csv") == 0;
+
+    if (t->csv) {
+        fprintf(t->file, "tick,type,i0,i1,f0,f1\n");
+    } else {
+        Telemetry_File_Header header = { TELEMETRY_MAGIC, TELEMETRY_VERSION, sizeof(Telemetry_Record), 0.016f };
+        fwrite(&header, sizeof(header), 1, t->file);
+    }
+
+    t->dropped = 0;
+    t->running = true;
+    t->enabled = 1;
+    t->writer  = std::thread(telemetry_writer_main, t);
+    return true;
+}
+
+void telemetry_stop(Telemetry *t) {
+    if (!t->enabled) return;
+
+    t->running.store(false, std::memory_order_release);
+    t->writer.join();
+    t->enabled = 0;
+
+    if (t->dropped) fprintf(stderr, "[telemetry] dropped %u records; the writer could not keep up.\n", (unsigned)t->dropped);
+    fclose(t->file);
+    t->file = NULL;
+}
+
+inline void telemetry_push(int type, int32_t i0, int32_t i1, float f0 = 0, float f1 = 0) {
+    if (!telemetry.enabled) return;
+
+    Telemetry_Record r;
+    r.tick = (uint32_t)game.tick;
+    r.type = (uint32_t)type;
+    r.i0   = i0;
+    r.i1   = i1;
+    r.f0   = f0;
+    r.f1   = f1;
+
+    if (!telemetry.queue.push(r)) telemetry.dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+// ===================================
+// Particles.
+// cosmetic only: a fixed SoA pool that never shares slots with entities[] and is
+// stepped once per rendered frame, not in the fixed update. live particles are
+// kept packed at the front, so the update kernel runs over [0, count) four at a time.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PARTICLES_SSE 1
+#endif
+
+#define PARTICLE_CAPACITY        4096 // multiple of 4: the kernel reads whole lanes.
+#define PARTICLE_SPAWN_PER_FRAME 512  // hard cap on new particles between two updates.
+#define PARTICLE_GRAVITY         240.0f
+#define PARTICLE_DRAG            0.92f // velocity kept per 1/60 s.
+
+enum {
+    EFFECT_CAPTURE,
+    EFFECT_HIT,
+    EFFECT_WALLJUMP,
+};
+
+struct Particle_Pool {
+    alignas(16) float x[PARTICLE_CAPACITY];
+    alignas(16) float y[PARTICLE_CAPACITY];
+    alignas(16) float vx[PARTICLE_CAPACITY];
+    alignas(16) float vy[PARTICLE_CAPACITY];
+    alignas(16) float life[PARTICLE_CAPACITY];     // seconds left.
+    alignas(16) float max_life[PARTICLE_CAPACITY];
+    alignas(16) float size[PARTICLE_CAPACITY];
+    Color             color[PARTICLE_CAPACITY];
+
+    int         count;
+    int         spawned_this_frame;
+    fz_Rng_Wide rng; // a cosmetic stream of its own; effects must not change the sim.
+};
+
+static Particle_Pool particles;
+
+void particles_spawn(Particle_Pool *p, Vector2 pos, Vector2 dir, float spread, float speed, float life, float size, Color color, int n) {
+    // degrade before hitting the wall: the fuller the pool, the smaller the burst.
+    float free_fraction = 1.0f - (float)p->count / PARTICLE_CAPACITY;
+    n = (int)(n * fminf(1.0f, free_fraction * 2.0f));
+
+    int budget = PARTICLE_SPAWN_PER_FRAME - p->spawned_this_frame;
+    if (n > budget) n = budget;
+    if (n > PARTICLE_CAPACITY - p->count) n = PARTICLE_CAPACITY - p->count;
+    if (n <= 0) return;
+
+    // four draws per particle, all in one batch.
+    float r[PARTICLE_SPAWN_PER_FRAME * 4];
+    fz_rng_wide_fill_f32(&p->rng, r, n * 4);
+
+    float base_angle = atan2f(dir.y, dir.x);
+    for (int k = 0; k < n; ++k) {
+        int i = p->count++;
+        const float *rk = r + k * 4;
+        float angle = base_angle + spread * (rk[0] * 2.0f - 1.0f);
+        float v     = speed * (0.3f + 0.7f * rk[1]);
+
+        p->x[i]        = pos.x;
+        p->y[i]        = pos.y;
+        p->vx[i]       = cosf(angle) * v;
+        p->vy[i]       = sinf(angle) * v;
+        p->life[i]     = life * (0.6f + 0.4f * rk[2]);
+        p->max_life[i] = p->life[i];
+        p->size[i]     = size * (0.5f + 0.5f * rk[3]);
+        p->color[i]    = color;
+    }
+    p->spawned_this_frame += n;
+}
+
+void particles_emit(Particle_Pool *p, int effect, Vector2 pos, Vector2 dir) {
+    switch(effect) {
+        case EFFECT_CAPTURE:  particles_spawn(p, pos, { 0, -1 }, PI, 220, 0.6f, 5, RED, 24); break;
+        case EFFECT_HIT:      particles_spawn(p, pos, { 0, -1 }, PI, 320, 0.9f, 6, BLACK, 64); break;
+        case EFFECT_WALLJUMP: particles_spawn(p, pos, dir, PI * 0.35f, 260, 0.4f, 4, BLUE, 20); break;
+
+        default:
+            assert(!"unknown effect.");
+    }
+}
+
+void particles_update(Particle_Pool *p, float dt) {
+    float drag = powf(PARTICLE_DRAG, dt * 60.0f);
+    int n = p->count;
+    int i = 0;
+
+#if defined(PARTICLES_SSE)
+    __m128 v_dt   = _mm_set1_ps(dt);
+    __m128 v_drag = _mm_set1_ps(drag);
+    __m128 v_grav = _mm_set1_ps(PARTICLE_GRAVITY * dt);
+
+    // lanes past count are garbage, but they're inside the arrays and nobody reads them.
+    for (; i < n; i += 4) {
+        __m128 vx = _mm_mul_ps(_mm_load_ps(p->vx + i), v_drag);
+        __m128 vy = _mm_add_ps(_mm_mul_ps(_mm_load_ps(p->vy + i), v_drag), v_grav);
+
+        _mm_store_ps(p->x  + i, _mm_add_ps(_mm_load_ps(p->x + i), _mm_mul_ps(vx, v_dt)));
+        _mm_store_ps(p->y  + i, _mm_add_ps(_mm_load_ps(p->y + i), _mm_mul_ps(vy, v_dt)));
+        _mm_store_ps(p->vx + i, vx);
+        _mm_store_ps(p->vy + i, vy);
+        _mm_store_ps(p->life + i, _mm_sub_ps(_mm_load_ps(p->life + i), v_dt));
+    }
+#else
+    for (; i < n; ++i) {
+        p->vx[i] *= drag;
+        p->vy[i]  = p->vy[i] * drag + PARTICLE_GRAVITY * dt;
+        p->x[i]  += p->vx[i] * dt;
+        p->y[i]  += p->vy[i] * dt;
+        p->life[i] -= dt;
+    }
+#endif
+
+    // swap-remove the dead ones to keep the live ones packed.
+    for (i = 0; i < p->count;) {
+        if (p->life[i] > 0) { ++i; continue; }
+
+        int last = --p->count;
+        p->x[i]        = p->x[last];
+        p->y[i]        = p->y[last];
+        p->vx[i]       = p->vx[last];
+        p->vy[i]       = p->vy[last];
+        p->life[i]     = p->life[last];
+        p->max_life[i] = p->max_life[last];
+        p->size[i]     = p->size[last];
+        p->color[i]    = p->color[last];
+    }
+
+    p->spawned_this_frame = 0;
+}
+
+void push_particles(Draw_List *dl, Particle_Pool *p) {
+    if (p->count == 0) return;
+    Draw_Cmd *cmd = push_draw(dl, DRAW_PARTICLES, BLACK);
+    cmd->particles = p;
+}
+
+// the whole pool in one loop; raylib batches the quads.
+void draw_particles(const Particle_Pool *p) {
+    for (int i = 0; i < p->count; ++i) {
+        float t = p->life[i] / p->max_life[i];
+        float s = p->size[i] * t;
+        Color c = p->color[i];
+        c.a = (unsigned char)(c.a * t);
+        DrawRectangleV({ p->x[i] - s * 0.5f, p->y[i] - s * 0.5f }, { s, s }, c);
+    }
+}
+
+// ===================================
+// Software renderer.
+// the draw list rasterized on the CPU, for when there's no window and no GL
+// context (--render-replay). not a second backend, a stand-in: rects, circles,
+// thick lines, alpha blending and glyphs drawn about the way raylib draws them,
+// without antialiasing.
+//
+// the frame is cut into SOFT_TILE tiles. soft_render() flattens the list first:
+// particles turn into rects, the camera offset is added to every position, and
+// every command gets the scissor it was recorded under as its clip rect. then
+// each command is binned, in order, into the tiles its clip touches, and the
+// workers take whole tiles off an atomic counter. a tile is only ever touched by
+// one thread, so blending needs no locks and keeps the draw order. whoever
+// finishes a tile also converts it into the output format.
+#define SOFT_TILE        64
+#define SOFT_MAX_WORKERS 16
+
+enum {
+    SOFT_OUTPUT_RGB,    // packed RGB, 3 bytes a pixel.
+    SOFT_OUTPUT_YUV420, // BT.601 full range Y plane, then quarter size U and V planes.
+};
+
+// pixels; x1 and y1 are exclusive.
+struct Soft_Clip {
+    int x0, y0, x1, y1;
+};
+
+struct Soft_Renderer {
+    int    width, height; // both even: 4:2:0 chroma is per 2x2 block.
+    int    tiles_x, tiles_y;
+    Color *pixels;
+    int      output;
+    uint8_t *out; // width * height * 3 bytes, whichever the output.
+    Color    clear;
+
+    // the flattened frame. for text, b.x is the spacing.
+    fz_Array<Draw_Cmd>  cmds;
+    fz_Array<Soft_Clip> clips;
+    fz_Array<int>       bin_start; // per tile, into bin_items; one extra at the end.
+    fz_Array<int>       bin_items; // indices into cmds.
+
+    std::thread       workers[SOFT_MAX_WORKERS];
+    int               worker_count;
+    std::atomic<bool> running;
+    std::atomic<int>  generation; // bumped once per frame; the workers wait on it.
+    std::atomic<int>  next_tile;
+    std::atomic<int>  tiles_done;
+};
+
+inline Soft_Clip soft_intersect(Soft_Clip a, Soft_Clip b) {
+    return { a.x0 > b.x0 ? a.x0 : b.x0, a.y0 > b.y0 ? a.y0 : b.y0,
+             a.x1 < b.x1 ? a.x1 : b.x1, a.y1 < b.y1 ? a.y1 : b.y1 };
+}
+
+inline Soft_Clip soft_bounds(float x0, float y0, float x1, float y1) {
+    return { (int)floorf(x0), (int)floorf(y0), (int)ceilf(x1), (int)ceilf(y1) };
+}
+
+inline bool soft_empty(Soft_Clip c) {
+    return c.x0 >= c.x1 || c.y0 >= c.y1;
+}
+
+// pixels whose centers fall in [from, to).
+inline void soft_span(float from, float to, int *x0, int *x1) {
+    *x0 = (int)ceilf(from - 0.5f);
+    *x1 = (int)ceilf(to - 0.5f);
+}
+
+// coverage: 0..256.
+inline void soft_blend(Color *dst, Color c, int coverage) {
+    int a = (c.a * coverage) >> 8;
+    if (a == 0) return;
+    if (a == 255) { *dst = c; dst->a = 255; return; }
+
+    int inv = 255 - a;
+    dst->r = (unsigned char)((c.r * a + dst->r * inv + 127) / 255);
+    dst->g = (unsigned char)((c.g * a + dst->g * inv + 127) / 255);
+    dst->b = (unsigned char)((c.b * a + dst->b * inv + 127) / 255);
+}
+
+inline void soft_fill_row(Soft_Renderer *r, int y, int x0, int x1, Color c) {
+    Color *row = r->pixels + (size_t)y * r->width;
+    if (c.a == 255) {
+        for (int x = x0; x < x1; ++x) row[x] = c;
+        return;
+    }
+    for (int x = x0; x < x1; ++x) soft_blend(&row[x], c, 256);
+}
+
+// the x range where lo <= k * x + c <= hi, narrowing [*x0, *x1]. false if it's empty.
+inline bool soft_slab(float k, float c, float lo, float hi, float *x0, float *x1) {
+    if (fabsf(k) < 1e-6f) return c >= lo && c <= hi;
+
+    float a = (lo - c) / k, b = (hi - c) / k;
+    if (a > b) { float t = a; a = b; b = t; }
+    if (a > *x0) *x0 = a;
+    if (b < *x1) *x1 = b;
+    return *x0 <= *x1;
+}
 
-const float MAP_X_BEGIN  = ((WINDOW_WIDTH - MAP_SIZE) * 0.5);
-const float MAP_X_END    = ((WINDOW_WIDTH + MAP_SIZE) * 0.5);
-const float MAP_X_CENTER = (MAP_X_BEGIN + ((MAP_X_END - MAP_X_BEGIN) * 0.5));
+// DrawLineEx: a rect `thick` wide along the line, flat ends.
+void soft_line(Soft_Renderer *r, const Draw_Cmd *cmd, Soft_Clip clip) {
+    Vector2 d = Vector2Subtract(cmd->b, cmd->a);
+    float length = Vector2Length(d);
+    if (length <= 0) return;
+    d = Vector2Scale(d, 1.0f / length);
+    float half = cmd->size * 0.5f;
+
+    // for a pixel center p, relative to a: along the line 0 <= dot(p, d) <= length,
+    // across it |cross(d, p)| <= half. per row, both are ranges of p.x.
+    for (int y = clip.y0; y < clip.y1; ++y) {
+        float py = y + 0.5f - cmd->a.y;
+        float u0 = clip.x0 + 0.5f - cmd->a.x, u1 = clip.x1 - 0.5f - cmd->a.x;
+        if (!soft_slab(d.x,  d.y * py, 0, length, &u0, &u1)) continue;
+        if (!soft_slab(-d.y, d.x * py, -half, half, &u0, &u1)) continue;
+
+        int from = (int)ceilf(u0 + cmd->a.x - 0.5f);
+        int to   = (int)floorf(u1 + cmd->a.x - 0.5f) + 1;
+        if (from < clip.x0) from = clip.x0;
+        if (to   > clip.x1) to   = clip.x1;
+        soft_fill_row(r, y, from, to, cmd->color);
+    }
+}
 
-const float MAP_Y_BEGIN  = ((WINDOW_HEIGHT - MAP_SIZE) * 0.5);
-const float MAP_Y_END    = ((WINDOW_HEIGHT + MAP_SIZE) * 0.5);
-const float MAP_Y_CENTER = (MAP_Y_BEGIN + ((MAP_Y_END - MAP_Y_BEGIN) * 0.5));
+void soft_circle(Soft_Renderer *r, const Draw_Cmd *cmd, Soft_Clip clip) {
+    float radius_sqr = cmd->size * cmd->size;
+    for (int y = clip.y0; y < clip.y1; ++y) {
+        float dy = y + 0.5f - cmd->a.y;
+        if (dy * dy > radius_sqr) continue;
+
+        float half = sqrtf(radius_sqr - dy * dy);
+        int from, to;
+        soft_span(cmd->a.x - half, cmd->a.x + half, &from, &to);
+        if (from < clip.x0) from = clip.x0;
+        if (to   > clip.x1) to   = clip.x1;
+        soft_fill_row(r, y, from, to, cmd->color);
+    }
+}
 
-struct Player {
-    float charge_amount;
-    int   holding_charge;
+// DrawCircleLines: a one pixel ring.
+void soft_circle_lines(Soft_Renderer *r, const Draw_Cmd *cmd, Soft_Clip clip) {
+    float inner = fmaxf(cmd->size - 0.5f, 0), outer = cmd->size + 0.5f;
+    inner *= inner;
+    outer *= outer;
+
+    for (int y = clip.y0; y < clip.y1; ++y) {
+        float dy = y + 0.5f - cmd->a.y;
+        Color *row = r->pixels + (size_t)y * r->width;
+        for (int x = clip.x0; x < clip.x1; ++x) {
+            float dx = x + 0.5f - cmd->a.x;
+            float d  = dx * dx + dy * dy;
+            if (d >= inner && d < outer) soft_blend(&row[x], cmd->color, 256);
+        }
+    }
+}
 
-    int     performing_walljump;
-    float   jump_timer;
-    Vector2 next_normal;
+// grayscale, transparent outside the image.
+inline float soft_texel(const uint8_t *src, int w, int h, int x, int y) {
+    if (x < 0 || y < 0 || x >= w || y >= h) return 0;
+    return src[y * w + x];
+}
 
-    Vector2 pos;
-    Vector2 size;
-    Vector2 normal;
-    Vector2 shoot_direction;
-};
+// DrawTextEx, off the glyph images LoadFontData made; bilinear, so the scaled
+// down sizes hold up.
+void soft_text(Soft_Renderer *r, const Draw_Cmd *cmd, Soft_Clip clip) {
+    const Font *font = cmd->font;
+    float scale   = cmd->size / font->baseSize;
+    float spacing = cmd->b.x;
+    Vector2 pen   = cmd->a;
+    Color color   = cmd->color;
+
+    for (const char *c = cmd->text; *c; ++c) {
+        if (*c == '\n') {
+            pen.x  = cmd->a.x;
+            pen.y += font->baseSize * 1.5f * scale;
+            continue;
+        }
 
-enum {
-    STATE_TITLE_SCREEN,
-    STATE_TUTORIAL,
-    STATE_PLAYING,
-    STATE_PLAYER_DIED,
-    STATE_LEADERBOARD,
-};
+        int index = (*c >= 32 && *c < 32 + font->glyphCount) ? *c - 32 : '?' - 32;
+        const GlyphInfo *g = &font->glyphs[index];
+        const Image *image = &g->image;
+        float x0 = pen.x + g->offsetX * scale;
+        float y0 = pen.y + g->offsetY * scale;
+        pen.x += (g->advanceX ? g->advanceX : font->recs[index].width) * scale + spacing;
+        if (!image->data || *c == ' ') continue;
+
+        Soft_Clip area = soft_intersect(clip, soft_bounds(x0, y0, x0 + image->width * scale, y0 + image->height * scale));
+        const uint8_t *src = (const uint8_t *)image->data;
+        int w = image->width, h = image->height;
+
+        for (int y = area.y0; y < area.y1; ++y) {
+            float sy = (y + 0.5f - y0) / scale - 0.5f;
+            int   iy = (int)floorf(sy);
+            float fy = sy - iy;
+            Color *row = r->pixels + (size_t)y * r->width;
+
+            for (int x = area.x0; x < area.x1; ++x) {
+                float sx = (x + 0.5f - x0) / scale - 0.5f;
+                int   ix = (int)floorf(sx);
+                float fx = sx - ix;
+
+                float top    = Lerp(soft_texel(src, w, h, ix, iy),     soft_texel(src, w, h, ix + 1, iy),     fx);
+                float bottom = Lerp(soft_texel(src, w, h, ix, iy + 1), soft_texel(src, w, h, ix + 1, iy + 1), fx);
+                int coverage = (int)(Lerp(top, bottom, fy) * (256.0f / 255.0f));
+                if (coverage > 0) soft_blend(&row[x], color, coverage);
+            }
+        }
+    }
+}
 
-struct Game {
-    int     state;
-    int     score;
+void soft_draw(Soft_Renderer *r, const Draw_Cmd *cmd, Soft_Clip clip) {
+    switch(cmd->type) {
+        case DRAW_RECT:
+        {
+            int x0, x1, y0, y1;
+            soft_span(cmd->a.x, cmd->a.x + cmd->b.x, &x0, &x1);
+            soft_span(cmd->a.y, cmd->a.y + cmd->b.y, &y0, &y1);
+            Soft_Clip area = soft_intersect(clip, { x0, y0, x1, y1 });
+            for (int y = area.y0; y < area.y1; ++y) soft_fill_row(r, y, area.x0, area.x1, cmd->color);
+        } break;
 
-    int     tutorial_happened;
+        case DRAW_LINE:         soft_line(r, cmd, clip);         break;
+        case DRAW_CIRCLE:       soft_circle(r, cmd, clip);       break;
+        case DRAW_CIRCLE_LINES: soft_circle_lines(r, cmd, clip); break;
+        case DRAW_TEXT:         soft_text(r, cmd, clip);         break;
 
-    float   state_change_timer;
-    float   state_change_max;
+        default:
+            assert(!"not a flattened draw command.");
+    }
+}
 
-    int     additional_score;
-    int     combo;
-    float   combo_timer;
+// BT.601, full range, in 8.8 fixed point.
+inline uint8_t soft_luma(Color c) {
+    return (uint8_t)((77 * c.r + 150 * c.g + 29 * c.b + 128) >> 8);
+}
 
-    float   timescale;
-    float   camerashake;
+// chroma rounds up to 256 on saturated blues and reds; it has to stop at 255.
+inline uint8_t soft_chroma(int c) {
+    return (uint8_t)(c < 0 ? 0 : c > 255 ? 255 : c);
+}
 
-    int     hitting_wall;
-    Vector2 hit_pos;
+// one tile: clear, every command binned to it in order, then the conversion.
+void soft_tile(Soft_Renderer *r, int tile) {
+    int tx = tile % r->tiles_x, ty = tile / r->tiles_x;
+    Soft_Clip area = { tx * SOFT_TILE, ty * SOFT_TILE, (tx + 1) * SOFT_TILE, (ty + 1) * SOFT_TILE };
+    area = soft_intersect(area, { 0, 0, r->width, r->height });
+
+    // Color and uint8_t stores may alias *r as far as the compiler knows; everything
+    // the pixel loops read from it goes into locals first.
+    int    w      = r->width;
+    Color *pixels = r->pixels;
+    Color  clear  = r->clear;
+    for (int y = area.y0; y < area.y1; ++y) {
+        Color *row = pixels + (size_t)y * w;
+        for (int x = area.x0; x < area.x1; ++x) row[x] = clear;
+    }
 
-    int captured_entity[256];
-    int captured_entity_count;
+    for (int i = r->bin_start[tile]; i < r->bin_start[tile + 1]; ++i) {
+        int index = r->bin_items[i];
+        soft_draw(r, &r->cmds[index], soft_intersect(r->clips[index], area));
+    }
 
-    int high_score[32];
-    int high_score_count;
-};
+    if (r->output == SOFT_OUTPUT_RGB) {
+        uint8_t *out = r->out;
+        for (int y = area.y0; y < area.y1; ++y) {
+            for (int x = area.x0; x < area.x1; ++x) {
+                Color c = pixels[(size_t)y * w + x];
+                uint8_t *o = out + ((size_t)y * w + x) * 3;
+                o[0] = c.r; o[1] = c.g; o[2] = c.b;
+            }
+        }
+        return;
+    }
 
-enum {
-    ENTITY_NONE,
-    ENTITY_ENEMY,
-    ENTITY_BULLET,
-    ENTITY_DEATH,
+    // tiles and the frame are even sized, so every 2x2 chroma block is in one tile.
+    uint8_t *luma   = r->out;
+    uint8_t *cb     = luma + (size_t)w * r->height;
+    uint8_t *cr     = cb + (size_t)(w / 2) * (r->height / 2);
+    int      half_w = w / 2;
+    for (int y = area.y0; y < area.y1; y += 2) {
+        const Color *top = pixels + (size_t)y * w, *bottom = top + w;
+        uint8_t *luma_top = luma + (size_t)y * w, *luma_bottom = luma_top + w;
+        uint8_t *u = cb + (size_t)(y / 2) * half_w, *v = cr + (size_t)(y / 2) * half_w;
+
+        for (int x = area.x0; x < area.x1; x += 2) {
+            Color a = top[x], b = top[x + 1], c = bottom[x], d = bottom[x + 1];
+            luma_top[x]        = soft_luma(a);
+            luma_top[x + 1]    = soft_luma(b);
+            luma_bottom[x]     = soft_luma(c);
+            luma_bottom[x + 1] = soft_luma(d);
+
+            int sum_r = a.r + b.r + c.r + d.r;
+            int sum_g = a.g + b.g + c.g + d.g;
+            int sum_b = a.b + b.b + c.b + d.b;
+            u[x / 2] = soft_chroma(128 + ((-43 * sum_r - 85 * sum_g + 128 * sum_b + 512) >> 10));
+            v[x / 2] = soft_chroma(128 + ((128 * sum_r - 107 * sum_g - 21 * sum_b + 512) >> 10));
+        }
+    }
+}
+
+void soft_run_tiles(Soft_Renderer *r) {
+    int count = r->tiles_x * r->tiles_y;
+    for (;;) {
+        int tile = r->next_tile.fetch_add(1, std::memory_order_acq_rel);
+        if (tile >= count) break;
+        soft_tile(r, tile);
+        r->tiles_done.fetch_add(1, std::memory_order_release);
+    }
+}
+
+// frames come back to back while rendering a replay, so the workers spin
+// (politely) instead of sleeping between them.
+void soft_worker_main(Soft_Renderer *r) {
+    int seen = 0;
+    while (r->running.load(std::memory_order_acquire)) {
+        int generation = r->generation.load(std::memory_order_acquire);
+        if (generation == seen) {
+            std::this_thread::yield();
+            continue;
+        }
+        seen = generation;
+        soft_run_tiles(r);
+    }
+}
+
+//! @param workers threads besides the calling one; capped at SOFT_MAX_WORKERS.
+void soft_init(Soft_Renderer *r, int width, int height, int output, int workers) {
+    assert(width % 2 == 0 && height % 2 == 0);
+    r->width   = width;
+    r->height  = height;
+    r->tiles_x = (width  + SOFT_TILE - 1) / SOFT_TILE;
+    r->tiles_y = (height + SOFT_TILE - 1) / SOFT_TILE;
+    // line aligned. for pixels that keeps tiles on different workers off each
+    // other's cache lines as long as a row is a whole number of lines (width a
+    // multiple of 16; a tile row is 256 bytes). out isn't padded, it's written
+    // straight to disk: its 3 * width RGB rows and width luma rows (3600 and
+    // 1200 bytes here) don't end on a line, so neighbouring tiles can share
+    // the lines at their edges. that's once per row per frame, at conversion.
+    r->pixels  = (Color *)fz_alloc_aligned(fz_global_allocator, sizeof(Color) * width * height, fz_CACHE_LINE);
+    r->out     = (uint8_t *)fz_alloc_aligned(fz_global_allocator, (size_t)width * height * 3, fz_CACHE_LINE);
+    r->output  = output;
+    r->clear   = WHITE;
+    r->bin_start.resize(r->tiles_x * r->tiles_y + 1);
+
+    r->worker_count = workers < SOFT_MAX_WORKERS ? workers : SOFT_MAX_WORKERS;
+    r->running    = true;
+    r->generation = 0;
+    r->next_tile  = r->tiles_x * r->tiles_y;
+    for (int i = 0; i < r->worker_count; ++i) {
+        r->workers[i] = std::thread(soft_worker_main, r);
+    }
+}
+
+void soft_destroy(Soft_Renderer *r) {
+    r->running.store(false, std::memory_order_release);
+    for (int i = 0; i < r->worker_count; ++i) r->workers[i].join();
+
+    fz_free(r->pixels);
+    fz_free(r->out);
+    r->cmds.release();
+    r->clips.release();
+    r->bin_start.release();
+    r->bin_items.release();
+}
+
+// copies one command into the flattened frame, offset and clipped.
+void soft_push(Soft_Renderer *r, Draw_Cmd cmd, Soft_Clip scissor, Vector2 offset) {
+    Soft_Clip bounds;
+    cmd.a = Vector2Add(cmd.a, offset);
+    switch(cmd.type) {
+        case DRAW_RECT:
+        {
+            bounds = soft_bounds(cmd.a.x, cmd.a.y, cmd.a.x + cmd.b.x, cmd.a.y + cmd.b.y);
+        } break;
+
+        case DRAW_LINE:
+        {
+            cmd.b = Vector2Add(cmd.b, offset);
+            float half = cmd.size * 0.5f;
+            bounds = soft_bounds(fminf(cmd.a.x, cmd.b.x) - half, fminf(cmd.a.y, cmd.b.y) - half,
+                                 fmaxf(cmd.a.x, cmd.b.x) + half, fmaxf(cmd.a.y, cmd.b.y) + half);
+        } break;
+
+        case DRAW_CIRCLE:
+        case DRAW_CIRCLE_LINES:
+        {
+            float radius = cmd.size + 1;
+            bounds = soft_bounds(cmd.a.x - radius, cmd.a.y - radius, cmd.a.x + radius, cmd.a.y + radius);
+        } break;
+
+        case DRAW_TEXT:
+        {
+            // DrawText: the default font at no less than 10 px, spaced by size / 10.
+            cmd.b.x = 0;
+            if (!cmd.font) {
+                cmd.font = main_font;
+                cmd.size = fmaxf(cmd.size, 10);
+                cmd.b.x  = cmd.size / 10;
+            }
+            if (!cmd.font || !cmd.font->glyphs) return;
+
+            // glyph offsets can reach a bit past the measured box.
+            Vector2 size = measure_glyphs(cmd.font, cmd.text, cmd.size, cmd.b.x);
+            float pad = cmd.size * 0.25f;
+            bounds = soft_bounds(cmd.a.x - pad, cmd.a.y - pad, cmd.a.x + size.x + pad, cmd.a.y + size.y + pad);
+        } break;
+
+        default:
+            assert(!"not a flattened draw command.");
+            return;
+    }
+
+    Soft_Clip clip = soft_intersect(bounds, scissor);
+    if (soft_empty(clip)) return;
+    r->cmds.push(cmd);
+    r->clips.push(clip);
+}
+
+// draws the list into r->pixels, and r->out in r->output's format.
+//! @param offset the camera offset: the game texture is drawn shifted by it. whole pixels only.
+void soft_render(Soft_Renderer *r, const Draw_List *dl, Vector2 offset) {
+    offset = { roundf(offset.x), roundf(offset.y) };
+    Soft_Clip screen  = { 0, 0, r->width, r->height };
+    Soft_Clip scissor = screen;
+
+    r->cmds.clear();
+    r->clips.clear();
+    for (const Draw_Cmd &cmd : *dl) {
+        switch(cmd.type) {
+            case DRAW_SCISSOR_BEGIN:
+            {
+                // BeginScissorMode takes ints.
+                Soft_Clip s = { (int)cmd.a.x, (int)cmd.a.y, (int)cmd.a.x + (int)cmd.b.x, (int)cmd.a.y + (int)cmd.b.y };
+                s = { s.x0 + (int)offset.x, s.y0 + (int)offset.y, s.x1 + (int)offset.x, s.y1 + (int)offset.y };
+                scissor = soft_intersect(s, screen);
+            } break;
+
+            case DRAW_SCISSOR_END: scissor = screen; break;
+
+            // draw_particles, one rect at a time.
+            case DRAW_PARTICLES:
+            {
+                const Particle_Pool *p = cmd.particles;
+                for (int i = 0; i < p->count; ++i) {
+                    float t = p->life[i] / p->max_life[i];
+                    float s = p->size[i] * t;
+                    Draw_Cmd rect = {};
+                    rect.type    = DRAW_RECT;
+                    rect.color   = p->color[i];
+                    rect.color.a = (unsigned char)(rect.color.a * t);
+                    rect.a       = { p->x[i] - s * 0.5f, p->y[i] - s * 0.5f };
+                    rect.b       = { s, s };
+                    soft_push(r, rect, scissor, offset);
+                }
+            } break;
+
+            default: soft_push(r, cmd, scissor, offset); break;
+        }
+    }
+
+    // bin: count per tile, prefix sum, then fill in order.
+    int tiles = r->tiles_x * r->tiles_y;
+    for (int t = 0; t <= tiles; ++t) r->bin_start[t] = 0;
+    for (const Soft_Clip &c : r->clips) {
+        for (int ty = c.y0 / SOFT_TILE; ty <= (c.y1 - 1) / SOFT_TILE; ++ty) {
+            for (int tx = c.x0 / SOFT_TILE; tx <= (c.x1 - 1) / SOFT_TILE; ++tx) {
+                r->bin_start[ty * r->tiles_x + tx + 1] += 1;
+            }
+        }
+    }
+    for (int t = 0; t < tiles; ++t) r->bin_start[t + 1] += r->bin_start[t];
+
+    r->bin_items.resize(r->bin_start[tiles]);
+    fz_Temp_Block scratch(frame_arena());
+    int *cursor = (int *)fz_alloc_ex(frame_allocator(), sizeof(int) * tiles);
+    memcpy(cursor, r->bin_start.begin(), sizeof(int) * tiles);
+    for (int i = 0; i < (int)r->clips.count(); ++i) {
+        const Soft_Clip &c = r->clips[i];
+        for (int ty = c.y0 / SOFT_TILE; ty <= (c.y1 - 1) / SOFT_TILE; ++ty) {
+            for (int tx = c.x0 / SOFT_TILE; tx <= (c.x1 - 1) / SOFT_TILE; ++tx) {
+                r->bin_items[cursor[ty * r->tiles_x + tx]++] = i;
+            }
+        }
+    }
+
+    // go. the store to next_tile publishes everything above to whoever picks up a tile.
+    r->tiles_done.store(0, std::memory_order_relaxed);
+    r->next_tile.store(0, std::memory_order_release);
+    r->generation.fetch_add(1, std::memory_order_release);
+
+    soft_run_tiles(r);
+    while (r->tiles_done.load(std::memory_order_acquire) < tiles) std::this_thread::yield();
+}
+
+// ===================================
+// Render state.
+// everything build_draw_list() needs from one tick, copied out of sim once the
+// tick is done. the simulation publishes, the renderer draws the latest one.
+// with --threaded-sim those are two threads running at their own pace, and
+// render_states makes sure they never touch the same copy.
+struct Render_State {
+    int      tick;
+    double   time; // wall clock the tick ended on.
+    Game     game;
+    Player   player;
+    Camera2D camera;
+
+    // live entities only, packed the same way sim.entities is.
+    int     entity_count;
+    Entity  entities[MAX_ENTITIES];
+    float   entity_timers[MAX_ENTITIES]; // seconds until its timer fires.
+
+    // sample time of the oldest input edge this state is the first to show; 0 if none.
+    double input_time;
+    double input_interval;
 };
 
-struct Entity {
-    int type;
-    int being_destroyed;
+static fz_Triple_Buffer<Render_State> render_states;
 
-    Vector2 position;
-    float cooldown;
+// particle bursts raised by the simulation; the render side emits them.
+static fz_SPSC_Queue<Game_Event, 512> render_effects;
 
-    Vector2 direction;
-    Vector2 target;
+struct Sim_Thread {
+    std::thread       thread;
+    std::atomic<bool> running;
 };
 
-struct Interval {
-    float max;
-    float current;
+static Sim_Thread sim_thread;
 
-    Interval(float m): max(m), current(m) {}
+// ===================================
+// Frame pacing.
+// the simulation stays at 62.5 Hz; rendering runs at whatever the display does
+// and draws one tick behind, blended between the two latest states.
+// when a frame takes too long, at most max_ticks run to catch up, then:
+//   CATCHUP_DROP: the rest of the backlog is dropped (the game skips ahead).
+//   CATCHUP_SLOW: the backlog is kept but capped, so the game runs in slow
+//                 motion until it has caught up.
+// either way a hitch can't turn into a death spiral.
+#define TICK_SECONDS        0.016
+#define RENDER_SNAP_DISTANCE 96.0 // moved further than this in one tick: teleported, don't blend.
+
+enum {
+    CATCHUP_DROP,
+    CATCHUP_SLOW,
 };
 
-struct Ground {
-    Vector2 begin;
-    Vector2 end;
+struct Pacing {
+    int max_ticks;   // per frame.
+    int policy;
+    int target_fps;  // 0: uncapped, -1: the monitor's refresh rate.
+    int interpolate;
 
-    Vector2 normal;
+    uint32_t dropped_ticks;
+    uint32_t capped_frames;
 };
 
-static Entity entities[1024];
+static Pacing pacing = { 5, CATCHUP_DROP, -1, 1 };
 
-static Camera2D camera = {{0}};
-static Player player = {0};
+// render side: the state before the latest one, and the blend of the two that gets drawn.
+static Render_State render_prev;
+static Render_State render_view;
 
-static Ground grounds[4];
+//! @return number of ticks to run now; *backlog keeps the time not simulated yet.
+int pacing_ticks(Pacing *p, double *backlog) {
+    int ticks = (int)(*backlog / TICK_SECONDS);
+    if (ticks <= p->max_ticks) return ticks;
 
-static Game game;
-static Font main_font;
-static Font bigger_font;
-const int MAINFONTSIZE = 58;
-const int BIGFONTSIZE  = 96;
+    p->capped_frames += 1;
+    double excess = *backlog - p->max_ticks * TICK_SECONDS;
+    switch(p->policy) {
+        case CATCHUP_DROP:
+        {
+            int dropped = (int)(excess / TICK_SECONDS);
+            p->dropped_ticks += dropped;
+            *backlog -= dropped * TICK_SECONDS;
+        } break;
 
-enum {
-    SOUND_GOT_HIT,
-    SOUND_SHOT_BULLET,
-    SOUND_ENEMY_DIED,
-    SOUND_TELEPORTED,
-    SOUND_SPAWN_ENEMY,
-};
+        case CATCHUP_SLOW:
+        {
+            // keep one frame's worth of catching up for next time, no more.
+            double cap = 2 * p->max_ticks * TICK_SECONDS;
+            if (*backlog > cap) *backlog = cap;
+        } break;
+    }
+    return p->max_ticks;
+}
+
+// only copies the live part.
+void render_state_copy(Render_State *out, const Render_State *rs) {
+    memcpy(out, rs, offsetof(Render_State, entities));
+    memcpy(out->entities,      rs->entities,      rs->entity_count * sizeof(Entity));
+    memcpy(out->entity_timers, rs->entity_timers, rs->entity_count * sizeof(float));
+    out->input_time     = rs->input_time;
+    out->input_interval = rs->input_interval;
+}
+
+inline Vector2 blend_position(Vector2 a, Vector2 b, float t) {
+    if (Vector2Distance(a, b) > RENDER_SNAP_DISTANCE) return b;
+    return Vector2Lerp(a, b, t);
+}
+
+// `to`, with positions pulled back toward `from` by (1 - t).
+void render_state_blend(Render_State *out, const Render_State *from, const Render_State *to, float t) {
+    static int16_t from_index[MAX_ENTITIES]; // by handle slot.
+
+    render_state_copy(out, to);
+    if (t >= 1.0) return;
+
+    out->player.pos           = sim_vec2(blend_position(sim_vector2(from->player.pos), sim_vector2(to->player.pos), t));
+    out->player.charge_amount = Lerp(from->player.charge_amount, to->player.charge_amount, t);
 
-static Sound sounds[8];
-static Music game_music;
+    memset(from_index, -1, sizeof(from_index));
+    for (int i = 0; i < from->entity_count; ++i) from_index[entity_slot_of(from->entities[i].handle)] = i;
+
+    for (int i = 0; i < to->entity_count; ++i) {
+        const Entity *e = &to->entities[i];
+        int j = from_index[entity_slot_of(e->handle)];
+        if (j < 0 || from->entities[j].handle != e->handle || from->entities[j].type != e->type) continue; // new this tick.
+
+        Vector2 a = sim_vector2(from->entities[j].position), b = sim_vector2(to->entities[i].position);
+        out->entities[i].position = sim_vec2(blend_position(a, b, t));
+    }
+}
 
 inline float timescaled_dt() {
     return game.timescale * 0.016;
 }
 
-inline float combo_multiplier() {
-    return (1.0f + (game.combo * 0.01));
+// timescaled_dt() for Sim_Real: the float product never gets into the sim.
+inline Sim_Real sim_dt() {
+    return sim_mul(sim_real(game.timescale), sim_real(0.016f));
 }
 
-inline int calc_additional_score() {
-    return (game.additional_score * combo_multiplier());
+inline float combo_multiplier(const Game *g = &sim.game) {
+    return (1.0f + (g->combo * 0.01));
 }
 
-inline int get_magnetbeam_threshold() {
-    return player.charge_amount * MAP_SIZE * 0.25;
+inline int calc_additional_score(const Game *g = &sim.game) {
+    return (g->additional_score * combo_multiplier(g));
 }
 
-void get_magnetbeam_line(Vector2 *begin, Vector2 *ends) {
-    *begin = Vector2Add(player.pos, { HALF_TILE, HALF_TILE });
-    *ends  = Vector2Add(*begin, Vector2Scale(player.shoot_direction, player.charge_amount * MAP_SIZE * 1.55));
+inline int get_magnetbeam_threshold(const Player *p = &sim.player) {
+    return p->charge_amount * MAP_SIZE * 0.25;
 }
 
-void do_debug_draw() {
+void get_magnetbeam(Sim_Vec2 *begin, Sim_Vec2 *ends, const Player *p = &sim.player) {
+    *begin = sim_add(p->pos, sim_vec2({ HALF_TILE, HALF_TILE }));
+    *ends  = sim_add(*begin, sim_scale(p->shoot_direction, sim_real(p->charge_amount * MAP_SIZE * 1.55f)));
+}
+
+void get_magnetbeam_line(Vector2 *begin, Vector2 *ends, const Player *p = &sim.player) {
+    Sim_Vec2 b, e;
+    get_magnetbeam(&b, &e, p);
+    *begin = sim_vector2(b);
+    *ends  = sim_vector2(e);
+}
+
+void do_debug_draw(Draw_List *dl) {
     Vector2 pos = { 10, 10 };
-    DrawText(TextFormat("Normal: [%f,%f]\n", player.normal.x, player.normal.y), pos.x, pos.y, 10, BLACK);
+    push_text(dl, NULL, frame_format("Normal: [%f,%f]\n", player.normal.x, player.normal.y), pos, 10, BLACK);
 
     pos.y += 10;
     if(player.performing_walljump) {
-        DrawText(TextFormat("Performing Wall jump to: [%f,%f]\n", player.next_normal.x, player.next_normal.y), pos.x, pos.y, 10, BLACK);
+        push_text(dl, NULL, frame_format("Performing Wall jump to: [%f,%f]\n", player.next_normal.x, player.next_normal.y), pos, 10, BLACK);
         pos.y += 10;
     }
 
     pos.y += 10;
-    for(int i = 0; i < fz_COUNTOF(entities); ++i) {
-        if (entities[i].type != ENTITY_NONE) {
-            DrawText(TextFormat("Entity: %d", entities[i].type), pos.x, pos.y, 10, BLACK);
-            pos.y += 10;
-        }
+    for(int i = 0; i < sim.entity_count; ++i) {
+        push_text(dl, NULL, frame_format("Entity: %d", entities[i].type), pos, 10, BLACK);
+        pos.y += 10;
     }
 }
 
+// the audio thread does the actual work; this only tells it what changed.
 void update_music() {
-    static float music_fade = 0;
-    if (!IsMusicStreamPlaying(game_music)) {
-        PlayMusicStream(game_music);
-        SeekMusicStream(game_music, 0);
-    }
-
-    if ((GetMusicTimeLength(game_music) - GetMusicTimePlayed(game_music)) < 0.25) {
-        SeekMusicStream(game_music, 0);
+    if (game_music != audio.bound_music) {
+        audio.bound_music = game_music;
+        audio_push(AUDIO_MUSIC_BIND, game_music);
     }
 
-    float last_frame = music_fade;
-    music_fade = Lerp(music_fade, !!(game.state == STATE_PLAYING), 0.05);
-
-    if(last_frame == 0.0 && game.state == STATE_PLAYING) {
-        ResumeMusicStream(game_music);
-    }
-    else if(music_fade == 0.0 && game.state != STATE_PLAYING) {
-        PauseMusicStream(game_music);
+    int fade = !!(game.state == STATE_PLAYING);
+    if (fade != audio.bound_fade) {
+        audio.bound_fade = fade;
+        audio_push(AUDIO_MUSIC_FADE, NULL, fade);
     }
-
-    SetMusicPitch(game_music, music_fade);
-    UpdateMusicStream(game_music);
 }
 
 void change_game_state(int state, float time) {
@@ -196,13 +3185,17 @@ void change_game_state(int state, float time) {
     game.hitting_wall = -1;
 
     if (game.state == STATE_PLAYING) {
-        for (int i = 0; i < fz_COUNTOF(entities); ++i) {
-            entities[i].type = 0;
-        }
+        entities_clear();
+
+        // every timer belonged to an entity that's gone now.
+        sim.timers.init();
+        sim.timer_carry = sim_real(0);
+        timer_start(1.0, TIMER_ENEMY_SPAWN);
 
         player.charge_amount = 0;
-        player.pos    = { MAP_X_CENTER - HALF_TILE, MAP_Y_CENTER - HALF_TILE};
-        player.normal = { 0, -1 };
+        player.pos     = sim_vec2({ level.spawn.x - HALF_TILE, level.spawn.y - HALF_TILE });
+        player.surface = level.spawn_surface;
+        player.normal  = level.grounds[player.surface].normal;
         player.performing_walljump = 0;
 
         game.score = 0;
@@ -211,20 +3204,166 @@ void change_game_state(int state, float time) {
         game.combo_timer = 0;
         game.hitting_wall = -1;
         game.timescale = 1;
+
+        game.run_start_tick = game.tick;
+        game.run_kills = 0;
     }
 }
 
-int interval_tick(Interval *it, float dt) {
-    it->current -= dt;
-    if (it->current < 0) {
-        it->current = it->max;
-        return 1;
+static volatile int sort_bench_sink; // keeps the timed sorts from being thrown out.
+
+inline int sort_bench_compare(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// ns per element of sorting a fresh copy of source, averaged over `rounds`.
+template<typename Sort>
+double sort_bench_time(const int *source, int *work, int n, int rounds, Sort sort) {
+    using Clock = std::chrono::steady_clock;
+    double total = 0;
+    for (int r = 0; r < rounds; ++r) {
+        memcpy(work, source, sizeof(int) * n);
+        auto t0 = Clock::now();
+        sort(work);
+        total += std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+        sort_bench_sink += work[n / 2];
     }
-    return 0;
+    return total / rounds / n;
+}
+
+//! --bench-sort: fz_sort against std::sort and qsort, and fz_radix_sort, on
+//! random ints. the leaderboard's 32 entries and a few bigger ones.
+void sort_benchmark() {
+    fz_Rng rng;
+    fz_rng_seed(&rng, 1);
+
+    printf("[sort] %8s %12s %12s %12s %12s\n", "n", "fz_sort ns", "std::sort ns", "qsort ns", "radix ns");
+    for (int n = 32; n <= (1 << 20); n *= 32) {
+        fz_Array<int> source, work, scratch;
+        source.resize(n);
+        work.resize(n);
+        scratch.resize(n);
+        for (int i = 0; i < n; ++i) source[i] = (int)fz_rng_u32(&rng);
+
+        // small inputs repeat so the clock has something to measure.
+        const int rounds = (1 << 22) / n > 0 ? (1 << 22) / n : 1;
+        int *tmp = scratch.data;
+
+        double ours  = sort_bench_time(source.data, work.data, n, rounds, [n](int *a) { fz_sort(a, n, [](int x, int y) { return x < y; }); });
+        double std_  = sort_bench_time(source.data, work.data, n, rounds, [n](int *a) { std::sort(a, a + n); });
+        double libc  = sort_bench_time(source.data, work.data, n, rounds, [n](int *a) { qsort(a, n, sizeof(int), sort_bench_compare); });
+        double radix = sort_bench_time(source.data, work.data, n, rounds, [n, tmp](int *a) {
+            fz_radix_sort(a, tmp, n, [](int x) { return fz_radix_key_i32(x); });
+        });
+
+        printf("[sort] %8d %12.2f %12.2f %12.2f %12.2f\n", n, ours, std_, libc, radix);
+    }
+}
+
+static volatile int alloc_bench_sink;
+static volatile int alloc_bench_opaque; // always 0, but the compiler can't know.
+
+// the allocator as the code outside sees it: which oper_func only turns up at
+// run time, so a call through it can't be turned back into the direct one.
+inline fz_Allocator alloc_bench_erase(fz_Allocator a) {
+    return alloc_bench_opaque ? fz_global_allocator : a;
+}
+
+struct Alloc_Bench_Item {
+    float x, y, z;
+    int   a, b, c, d;
+}; // 28 bytes, about a Game_Event.
+
+// ns per operation of `ops` operations a round, averaged over `rounds`.
+template<typename Run>
+double alloc_bench_time(int ops, int rounds, Run run) {
+    using Clock = std::chrono::steady_clock;
+    auto t0 = Clock::now();
+    for (int r = 0; r < rounds; ++r) run();
+    return std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / rounds / ops;
+}
+
+// n small allocations, dropped together at the end of the round.
+template<typename Policy>
+void alloc_bench_arena(fz_Arena *arena, Policy policy, int n) {
+    fz_Temp_Block scratch(*arena);
+    for (int i = 0; i < n; ++i) {
+        uint8_t *p = (uint8_t *)policy.allocate(24, 8);
+        p[0] = (uint8_t)i;
+        alloc_bench_sink += p[0];
+    }
+}
+
+// pushes `depth` deep, then pops back down.
+template<typename Policy>
+void alloc_bench_stack(Policy policy, int depth) {
+    void *held[16];
+    for (int i = 0; i < depth; ++i) held[i] = policy.allocate(24, 8);
+    for (int i = depth - 1; i >= 0; --i) policy.deallocate(held[i]);
 }
 
-int scoresort(const void *a, const void *b) {
-    return (*(const int*)b) - (*(const int *)a);
+// takes `count` elements, then hands them back: after the first round it's all free list.
+template<typename Policy>
+void alloc_bench_pool(Policy policy, int count) {
+    void *held[64];
+    for (int i = 0; i < count; ++i) held[i] = policy.allocate(sizeof(Alloc_Bench_Item), alignof(Alloc_Bench_Item));
+    for (int i = 0; i < count; ++i) policy.deallocate(held[i]);
+}
+
+// an fz_Array grown one push at a time, in an arena.
+template<typename Policy>
+void alloc_bench_array(fz_Arena *arena, Policy policy, int n) {
+    fz_Temp_Block scratch(*arena);
+    fz_Array<Alloc_Bench_Item, 0, Policy> items(policy);
+    for (int i = 0; i < n; ++i) items.push({ 0, 0, 0, i, i, i, i });
+    alloc_bench_sink += items[n / 2].a;
+}
+
+//! --bench-alloc: the arena, stack and pool through an fz_Allocator, against
+//! the same ones as compile-time policies, and an fz_Array on each kind.
+void alloc_benchmark() {
+    const int N      = 1 << 16;
+    const int ROUNDS = 1000;
+
+    fz_Arena arena;
+    if (!fz_arena_init_virtual(&arena, 64 * fz_MB, 0)) {
+        fprintf(stderr, "[alloc] could not reserve the benchmark arena\n");
+        return;
+    }
+
+    static uint8_t stack_memory[4096];
+    fz_StackAlloc stack;
+    fz_stack_init(&stack, stack_memory, sizeof(stack_memory));
+
+    static uint8_t pool_memory[64 * 64];
+    fz_Pool pool;
+    fz_pool_init_aligned(&pool, pool_memory, sizeof(pool_memory), sizeof(Alloc_Bench_Item), alignof(Alloc_Bench_Item));
+
+    fz_Dynamic_Policy arena_dynamic(alloc_bench_erase(fz_arena_allocator(&arena)));
+    fz_Dynamic_Policy stack_dynamic(alloc_bench_erase(fz_stack_allocator(&stack)));
+    fz_Dynamic_Policy pool_dynamic(alloc_bench_erase(fz_pool_allocator(&pool)));
+
+    struct Row { const char *name; double dynamic, policy; } rows[] = {
+        { "arena 24 B",
+          alloc_bench_time(N, ROUNDS, [&]() { alloc_bench_arena(&arena, arena_dynamic, N); }),
+          alloc_bench_time(N, ROUNDS, [&]() { alloc_bench_arena(&arena, fz_Arena_Policy(&arena), N); }) },
+        { "stack 16 deep",
+          alloc_bench_time(2 * 16, N, [&]() { alloc_bench_stack(stack_dynamic, 16); }),
+          alloc_bench_time(2 * 16, N, [&]() { alloc_bench_stack(fz_Stack_Policy(&stack), 16); }) },
+        { "pool 64",
+          alloc_bench_time(2 * 64, N / 4, [&]() { alloc_bench_pool(pool_dynamic, 64); }),
+          alloc_bench_time(2 * 64, N / 4, [&]() { alloc_bench_pool(fz_Pool_Policy(&pool), 64); }) },
+        { "array push",
+          alloc_bench_time(N, ROUNDS, [&]() { alloc_bench_array(&arena, arena_dynamic, N); }),
+          alloc_bench_time(N, ROUNDS, [&]() { alloc_bench_array(&arena, fz_Arena_Policy(&arena), N); }) },
+    };
+
+    printf("[alloc] %-14s %16s %12s\n", "", "fz_Allocator ns", "policy ns");
+    for (int i = 0; i < (int)fz_COUNTOF(rows); ++i) {
+        printf("[alloc] %-14s %16.2f %12.2f\n", rows[i].name, rows[i].dynamic, rows[i].policy);
+    }
+    fz_arena_release(&arena);
 }
 
 void perform_player_death() {
@@ -245,110 +3384,247 @@ void perform_player_death() {
         game.high_score[found] = game.score;
     }
 
-    qsort(game.high_score, sizeof(game.high_score) / sizeof(int), sizeof(int), scoresort);
+    // 32 entries: highest first. comparing instead of subtracting, so it can't overflow.
+    fz_sort(game.high_score, fz_COUNTOF(game.high_score), [](int a, int b) { return a > b; });
     change_game_state(STATE_PLAYER_DIED, 1.0);
 }
 
-int spawn_entity(int type) {
-    int entity_id = 0;
-    for(int i = 1; i < fz_COUNTOF(entities); ++i) {
-        if (entities[i].type == ENTITY_NONE) {
-            entity_id = i;
-            break;
+void drain_events(Event_Queue *events) {
+    uint32_t played = 0;
+    int died = 0;
+
+    for (Game_Event &ev : *events) {
+        switch(ev.type) {
+            case EVENT_SOUND:
+            {
+                uint32_t bit = 1u << ev.sound;
+                if (events_play_audio && !(played & bit)) {
+                    audio_play(sounds[ev.sound]);
+                }
+                played |= bit;
+            } break;
+
+            case EVENT_SHAKE:     game.camerashake += ev.amount; break;
+            case EVENT_SHAKE_SET: game.camerashake  = ev.amount; break;
+
+            case EVENT_CAPTURE:
+            {
+                game.additional_score += ev.points;
+                game.combo       += 1;
+                game.combo_timer = fmin(game.combo_timer + 1.0, 5.0);
+                game.run_kills   += 1;
+
+                telemetry_push(TELEMETRY_CAPTURE, game.combo, game.run_kills, ev.pos.x, ev.pos.y);
+            } break;
+
+            case EVENT_COMBO_END:
+            {
+                telemetry_push(TELEMETRY_COMBO_BREAK, game.combo, calc_additional_score());
+                game.score += calc_additional_score();
+
+                game.combo = 0;
+                game.additional_score = 0;
+            } break;
+
+            case EVENT_PLAYER_DIED:
+            {
+                if (!died) {
+                    perform_player_death();
+                    float alive = (game.tick - game.run_start_tick) * 0.016f;
+                    telemetry_push(TELEMETRY_HIT, game.score, game.run_kills, alive);
+                }
+                died = 1;
+            } break;
+
+            case EVENT_SPAWNED:
+            {
+                telemetry_push(TELEMETRY_SPAWN, ENTITY_ENEMY, 0, ev.pos.x, ev.pos.y);
+            } break;
+
+            // particles belong to the render side; they get emitted when it picks these up.
+            case EVENT_EFFECT: render_effects.push(ev); break;
+
+            default:
+                assert(!"unknown event.");
         }
     }
+    events->clear();
+}
+
+void do_enemy_update(Entity *e) {
+    e->position = sim_lerp(e->position, e->target, sim_real(0.25f));
+}
+
+// TIMER_ENEMY_FIRE: shoot at the player, move somewhere else, wait 2 seconds.
+void enemy_fire(Entity *e) {
+    Entity *bullet = spawn_entity(ENTITY_BULLET);
+    if (!bullet) {
+        // no room for a bullet: try again next tick.
+        e->timer = timer_start(0.016, TIMER_ENEMY_FIRE, e->handle);
+        return;
+    }
+
+    bullet->position  = e->position;
+    bullet->direction = sim_normalize(sim_sub(player.pos, e->position));
 
-    entities[entity_id].type = type;
-    entities[entity_id].being_destroyed = 0;
+    e->timer = timer_start(2.0, TIMER_ENEMY_FIRE, e->handle);
 
-    return entity_id;
+    e->target = sim_vec2(level_random_point(&level, 100, &sim.rng));
+
+    emit_sound(SOUND_SHOT_BULLET);
 }
 
-void do_enemy_update(Entity *e) {
-    e->cooldown -= timescaled_dt();
-    e->position = Vector2Lerp(e->position, e->target, 0.25);
+// TIMER_ENEMY_SPAWN.
+void spawn_enemy() {
+    Entity *e = spawn_entity(ENTITY_ENEMY);
+    if (e) {
+        e->timer = timer_start(sim_random(1, 100) * 0.01, TIMER_ENEMY_FIRE, e->handle);
+        e->position = sim_vec2(level_random_point(&level, TILE_SIZE, &sim.rng));
+        e->target   = e->position;
+
+        emit_sound(SOUND_SPAWN_ENEMY);
+        emit_spawned(sim_vector2(e->position));
+    }
+    timer_start(1.0, TIMER_ENEMY_SPAWN);
+}
 
-    if (e->cooldown < 0) {
-        int id = spawn_entity(ENTITY_BULLET);
-        if (id) {
-            Entity *bullet = &entities[id];
+void timers_advance(Sim_Real dt) {
+    sim.timer_carry = sim_add(sim.timer_carry, sim_mul(dt, sim_real(TIMER_UNITS_PER_SECOND)));
+    int units = sim_floor(sim.timer_carry);
+    sim.timer_carry = sim_sub(sim.timer_carry, sim_real(units));
 
-            bullet->position  = e->position;
-            bullet->direction = Vector2Normalize(Vector2Subtract(player.pos, e->position));
+    sim.timers.advance(units, [](fz_Timer_Handle handle, int kind, uint32_t user) {
+        switch(kind) {
+            case TIMER_ENEMY_SPAWN: spawn_enemy(); break;
 
-            e->cooldown = 2.0f;
+            case TIMER_ENEMY_FIRE:
+            {
+                Entity *e = entity_get(user);
+                assert(e && e->timer == handle && e->type == ENTITY_ENEMY);
+                if (!e) break;
+                e->timer = 0;
 
-            int x_pos = GetRandomValue((int)MAP_X_BEGIN + 100, (int)MAP_X_END - 100);
-            int y_pos = GetRandomValue((int)MAP_Y_BEGIN + 100, (int)MAP_Y_END - 100);
+                // already on its way out: no parting shot.
+                if (!e->being_destroyed) enemy_fire(e);
+            } break;
 
-            e->target = { (float)x_pos, (float)y_pos };
+            case TIMER_DEATH_EXPIRE:
+            {
+                Entity *e = entity_get(user);
+                assert(e && e->timer == handle && e->type == ENTITY_DEATH);
+                if (!e) break;
+                e->timer = 0;
+                e->being_destroyed = 1;
+            } break;
 
-            PlaySoundMulti(sounds[SOUND_SHOT_BULLET]);
+            default:
+                assert(!"unknown timer.");
         }
+    });
+}
+
+// CheckCollisionCircleRec, in sim numbers.
+inline bool sim_circle_hits_rect(Sim_Vec2 center, Sim_Real radius, Sim_Vec2 pos, Sim_Vec2 size) {
+    Sim_Vec2 closest;
+    closest.x = sim_clamp(center.x, pos.x, sim_add(pos.x, size.x));
+    closest.y = sim_clamp(center.y, pos.y, sim_add(pos.y, size.y));
+
+    // far off on either axis is a miss, and keeps the dot below from overflowing fixed point.
+    Sim_Vec2 d = sim_sub(center, closest);
+    if (sim_less(radius, sim_abs(d.x)) || sim_less(radius, sim_abs(d.y))) return false;
+    return !sim_less(sim_mul(radius, radius), sim_dot(d, d));
+}
+
+// all bullets move by the same step, so they move together: gathered into
+// one run for sim_advance(), which in fixed point is a SIMD kernel.
+void bullets_advance(Sim_Real step) {
+    fz_Temp_Block scratch(frame_arena());
+    int16_t  *slots = (int16_t *)fz_alloc_ex(frame_allocator(), sizeof(int16_t) * sim.entity_count);
+    Sim_Vec2 *pos   = (Sim_Vec2 *)fz_alloc_ex(frame_allocator(), sizeof(Sim_Vec2) * sim.entity_count);
+    Sim_Vec2 *dir   = (Sim_Vec2 *)fz_alloc_ex(frame_allocator(), sizeof(Sim_Vec2) * sim.entity_count);
+
+    int count = 0;
+    for (int i = 0; i < sim.entity_count; ++i) {
+        if (entities[i].type != ENTITY_BULLET || entities[i].being_destroyed) continue;
+        slots[count] = i;
+        pos[count]   = entities[i].position;
+        dir[count]   = entities[i].direction;
+        count += 1;
     }
+
+    sim_advance(pos, dir, step, count);
+    for (int i = 0; i < count; ++i) entities[slots[i]].position = pos[i];
+}
+
+// CheckCollisionPointLine, in sim numbers: within `threshold` of the beam and
+// between its ends. how far down the beam p lands goes in *along.
+inline bool sim_near_beam(Sim_Vec2 p, Sim_Vec2 begin, Sim_Vec2 dir, Sim_Real length, Sim_Real threshold, Sim_Real *along) {
+    Sim_Vec2 rel = sim_sub(p, begin);
+    *along = sim_dot(rel, dir);
+    if (sim_less(*along, sim_real(0)) || sim_less(length, *along)) return false;
+
+    Sim_Vec2 off = sim_sub(rel, sim_scale(dir, *along));
+    return sim_less(sim_length(off), threshold);
 }
 
 void do_bullet_update(Entity *e) {
-    e->position = Vector2Add(e->position, Vector2Scale(e->direction, timescaled_dt() * 60));
-    Rectangle player_rec = { player.pos.x, player.pos.y, player.size.x, player.size.y };
-    if (CheckCollisionCircleRec(e->position, 4, player_rec)) {
+    if (sim_circle_hits_rect(e->position, sim_real(4), player.pos, sim_vec2(player.size))) {
         if (!player.performing_walljump) {
             e->being_destroyed = 1;
-            game.camerashake += 0.15;
-            PlaySoundMulti(sounds[SOUND_GOT_HIT]);
+            emit_shake(0.15);
+            emit_sound(SOUND_GOT_HIT);
+            emit_effect(EFFECT_HIT, sim_vector2(sim_add(player.pos, sim_vec2({ HALF_TILE, HALF_TILE }))));
 
-            perform_player_death();
+            emit_event(EVENT_PLAYER_DIED);
         }
         e->being_destroyed = 1;
     }
 }
 
-void do_death_update(Entity *e) {
-    e->cooldown -= timescaled_dt();
-    if (e->cooldown < 0) {
-        e->being_destroyed = 1;
-    }
-}
-
 void update_entities() {
-    for(int i = 0; i < fz_COUNTOF(entities); ++i) {
+    bullets_advance(sim_mul(sim_dt(), sim_real(60)));
+
+    for(int i = 0; i < sim.entity_count; ) {
         Entity *e = &entities[i];
 
-        if (e->type == ENTITY_NONE) continue;
-        if ((e->position.x < MAP_X_BEGIN) || (MAP_X_END < e->position.x)) {
+        Vector2 at = sim_vector2(e->position);
+        if ((at.x < level.min.x) || (level.max.x < at.x)) {
+            e->being_destroyed = 1;
+        }
+        if ((at.y < level.min.y) || (level.max.y < at.y)) {
             e->being_destroyed = 1;
         }
-        if ((e->position.y < MAP_Y_BEGIN) || (MAP_Y_END < e->position.y)) {
+        // bullets also stop at obstacles and concave bits of the arena.
+        if (e->type == ENTITY_BULLET && !level_contains(&level, at)) {
             e->being_destroyed = 1;
         }
 
         if (e->being_destroyed) {
-            e->type = ENTITY_NONE;
+            destroy_entity(e); // the last one moved in here and gets its turn next.
             continue;
         }
 
         switch(e->type) {
             case ENTITY_ENEMY:  do_enemy_update(e);  break;
             case ENTITY_BULLET: do_bullet_update(e); break;
-            case ENTITY_DEATH:  do_death_update(e);  break;
+            case ENTITY_DEATH:  break; // waits on its TIMER_DEATH_EXPIRE.
 
             default:
                 assert(!"What the heck!?");
         }
+        i += 1;
     }
 }
 
 void update_player_input(int x_axis, int charging, Vector2 mouse) {
-    static float accel = 0;
-
     if (!player.performing_walljump) {
         // What a weird way to perform an acceleration.
-        accel = Lerp(accel, (x_axis * 8), 8 * timescaled_dt());
-        Vector2 movedir = { -player.normal.y, -player.normal.x };
+        sim.accel = sim_lerp(sim.accel, sim_real(x_axis * 8), sim_mul(sim_real(8), sim_dt()));
+        Sim_Vec2 movedir = sim_vec2(surface_tangent(player.normal));
 
-        Vector2 accele = Vector2Scale(movedir, accel);
-        player.pos = Vector2Add(player.pos, accele);
-        player.shoot_direction = Vector2Normalize(Vector2Subtract(mouse, Vector2Add(player.pos, { HALF_TILE, HALF_TILE })));
+        Sim_Vec2 accele = sim_scale(movedir, sim.accel);
+        player.pos = sim_add(player.pos, accele);
+        player.shoot_direction = sim_normalize(sim_sub(sim_vec2(mouse), sim_add(player.pos, sim_vec2({ HALF_TILE, HALF_TILE }))));
 
         player.holding_charge = charging;
 
@@ -358,32 +3634,16 @@ void update_player_input(int x_axis, int charging, Vector2 mouse) {
 }
 
 void do_player_update() {
-    Vector2 norm = player.normal;
     if (!player.performing_walljump) {
-        // what is this monstrosity?
-
-        if (norm.y == -1) {
-            player.pos.y = MAP_Y_END - TILE_SIZE;
-        } else if (norm.y == 1) {
-            player.pos.y = MAP_Y_BEGIN;
-        } else if (norm.x == 1) {
-            player.pos.x = MAP_X_BEGIN;
-        } else if (norm.x == -1) {
-            player.pos.x = MAP_X_END - TILE_SIZE;
-        } else {
-            assert(!"how did this happen?");
-        }
-
-        if (player.pos.x < MAP_X_BEGIN) player.pos.x = MAP_X_BEGIN;
-        if (player.pos.x + TILE_SIZE > MAP_X_END)   player.pos.x = MAP_X_END - TILE_SIZE;
-        if (player.pos.y < MAP_Y_BEGIN) player.pos.y = MAP_Y_BEGIN;
-        if (player.pos.y + TILE_SIZE > MAP_Y_END)   player.pos.y = MAP_Y_END - TILE_SIZE;
+        Sim_Vec2 half   = sim_vec2({ HALF_TILE, HALF_TILE });
+        Sim_Vec2 center = level_attach(&level, player.surface, sim_add(player.pos, half));
+        player.pos = sim_sub(center, half);
 
         if (player.holding_charge) {
             player.charge_amount += timescaled_dt();
         } else {
             if (game.hitting_wall != -1) {
-                Ground g = grounds[game.hitting_wall];
+                Ground g = level.grounds[game.hitting_wall];
 
                 player.performing_walljump = 1;
                 player.next_normal = g.normal;
@@ -391,25 +3651,25 @@ void do_player_update() {
 
                 game.captured_entity_count = 0;
 
-                Vector2 mlineb, mlinee;
-                get_magnetbeam_line(&mlineb, &mlinee);
+                Sim_Vec2 mlineb, mlinee;
+                get_magnetbeam(&mlineb, &mlinee);
                 int threshold = get_magnetbeam_threshold() * 0.5;
 
-                for(int i = 0; i < fz_COUNTOF(entities); ++i) {
+                Sim_Vec2 linenorm = sim_normalize(sim_sub(mlinee, mlineb));
+                Sim_Real length   = sim_length(sim_sub(mlinee, mlineb));
+
+                for(int i = 0; i < sim.entity_count; ++i) {
                     Entity *e = &entities[i];
                     if (e->being_destroyed) continue;
-                    if (e->type == ENTITY_NONE) continue;
-
-                    if (e->type == ENTITY_ENEMY) {
-                        if(CheckCollisionPointLine(e->position, mlineb, mlinee, threshold)) {
-                            game.captured_entity[game.captured_entity_count++] = i;
 
-                            Vector2 linenorm = Vector2Normalize(Vector2Subtract(mlinee, mlineb));
-                            Vector2 begin = Vector2Subtract(e->position, mlineb);
-                            float dist = Vector2DotProduct(begin, linenorm);
+                    if (e->type == ENTITY_ENEMY && game.captured_entity_count < fz_COUNTOF(game.captured_entity)) {
+                        Sim_Real dist;
+                        if (sim_near_beam(e->position, mlineb, linenorm, length, sim_real(threshold), &dist)) {
+                            game.captured_entity[game.captured_entity_count++] = e->handle;
 
-                            e->cooldown = 100000.0;
-                            e->target = Vector2Add(mlineb, Vector2Scale(linenorm, dist));
+                            // captured: it doesn't get to shoot again.
+                            timer_cancel(&e->timer);
+                            e->target = sim_add(mlineb, sim_scale(linenorm, dist));
                         }
                     }
                 }
@@ -425,45 +3685,315 @@ void do_player_update() {
             player.charge_amount = 0;
             player.holding_charge = 0;
             player.normal = player.next_normal;
+            player.surface = game.hitting_wall;
             player.pos = game.hit_pos;
             game.hitting_wall = -1;
-            game.camerashake = 0.25;
-
-            PlaySoundMulti(sounds[SOUND_TELEPORTED]);
+            emit_shake_set(0.25);
+            emit_sound(SOUND_TELEPORTED);
+            emit_effect(EFFECT_WALLJUMP, sim_vector2(game.hit_pos), player.normal);
 
             if (game.captured_entity_count > 0) {
                 game.timescale = 0.01;
-                PlaySoundMulti(sounds[SOUND_ENEMY_DIED]);
+                emit_sound(SOUND_ENEMY_DIED);
             }
 
             for (int i = 0; i < game.captured_entity_count; ++i) {
-                int killing = game.captured_entity[i];
-                entities[killing].type = ENTITY_DEATH;
-                entities[killing].cooldown = 1.0;
+                // gone during the jump (or its slot went to something else): nothing to kill.
+                Entity *killing = entity_get(game.captured_entity[i]);
+                if (!killing || killing->being_destroyed) continue;
 
-                game.additional_score += 50;
-                game.combo       += 1;
-                game.combo_timer = fmin(game.combo_timer + 1.0, 5.0);
-                game.camerashake += 0.05;
+                killing->type  = ENTITY_DEATH;
+                killing->timer = timer_start(1.0, TIMER_DEATH_EXPIRE, killing->handle);
+
+                emit_capture(50, sim_vector2(killing->position));
+                emit_effect(EFFECT_CAPTURE, sim_vector2(killing->position));
+                emit_shake(0.05);
             }
         } else if (player.jump_timer < 0.08) {
-            player.pos = Vector2Lerp(player.pos, game.hit_pos, 0.25);
+            player.pos = sim_lerp(player.pos, game.hit_pos, sim_real(0.25f));
         } else {
-            player.pos  = Vector2Add(player.pos, player.normal);
+            player.pos  = sim_add(player.pos, sim_vec2(player.normal));
+        }
+    }
+}
+
+// ===================================
+// Input.
+// raylib polls once per frame, while the accumulator runs zero or more ticks
+// per frame. so input_sample() turns whatever changed since the last frame
+// into timestamped events, and each tick takes only the events that are due
+// by its deadline. a press is seen by exactly one tick: never dropped when a
+// frame runs no tick, never repeated when it runs several.
+//
+// sampling happens on the main thread, consuming on whichever thread runs
+// the simulation; the queue between them is an fz_SPSC_Queue.
+//
+// latency: every edge remembers when it was sampled. the Render_State of the
+// tick that applied it carries that time, and presenting the state records
+// sample -> present. the edge itself happened
+// somewhere between the previous sample and this one, so the interval between
+// samples is kept as the upper bound.
+#define INPUT_QUEUE_SIZE  256
+#define INPUT_LATENCY_MAX 64   // ms; histogram range, 1 ms buckets.
+
+enum {
+    INPUT_KEY_DOWN,
+    INPUT_KEY_UP,
+    INPUT_BUTTON_DOWN,
+    INPUT_BUTTON_UP,
+    INPUT_MOUSE_MOVE,
+};
+
+struct Input_Event {
+    double  time;     // when it was sampled.
+    double  interval; // how long since the sample before it.
+    int     type;
+    int     code;
+    Vector2 pos;
+};
+
+// the keys the game cares about; Tick_Input indexes by position in here.
+static const int input_keys[] = { KEY_A, KEY_D, KEY_BACKSPACE, KEY_F5, KEY_F9 };
+enum { INPUT_A, INPUT_D, INPUT_BACKSPACE, INPUT_F5, INPUT_F9 };
+static const int input_buttons[] = { MOUSE_LEFT_BUTTON, MOUSE_RIGHT_BUTTON };
+enum { INPUT_LMB, INPUT_RMB };
+
+// what one tick gets to see.
+struct Tick_Input {
+    int     keys_down[fz_COUNTOF(input_keys)];
+    int     keys_pressed[fz_COUNTOF(input_keys)];
+    int     buttons_down[fz_COUNTOF(input_buttons)];
+    int     buttons_pressed[fz_COUNTOF(input_buttons)];
+    Vector2 mouse;
+};
+
+struct Input_Latency {
+    uint32_t histogram[INPUT_LATENCY_MAX + 1]; // last bucket: everything over.
+    uint32_t count;
+    double   total_ms;
+    double   total_upper_ms;
+    double   worst_ms;
+};
+
+struct Input {
+    fz_SPSC_Queue<Input_Event, INPUT_QUEUE_SIZE> events;
+    uint32_t overflowed;
+
+    // sampler side: what the last sample saw.
+    int     sampled_keys[fz_COUNTOF(input_keys)];
+    int     sampled_buttons[fz_COUNTOF(input_buttons)];
+    Vector2 sampled_mouse;
+    double  last_sample;
+
+    // tick side: the state after every consumed event.
+    Tick_Input held;
+
+    // edges applied since the last published Render_State: the oldest one is what we time.
+    double pending_time;
+    double pending_interval;
+    int    pending;
+
+    Input_Latency latency;
+};
+
+static Input input;
+
+void input_push(Input *in, int type, int code, Vector2 pos, double now) {
+    Input_Event ev;
+    ev.time     = now;
+    ev.interval = now - in->last_sample;
+    ev.type     = type;
+    ev.code     = code;
+    ev.pos      = pos;
+    if (!in->events.push(ev)) in->overflowed += 1;
+}
+
+// once per frame, right after raylib polled.
+void input_sample(Input *in, double now) {
+    if (in->last_sample == 0) in->last_sample = now;
+
+    for (int i = 0; i < fz_COUNTOF(input_keys); ++i) {
+        int down = IsKeyDown(input_keys[i]);
+        if (down != in->sampled_keys[i]) {
+            input_push(in, down ? INPUT_KEY_DOWN : INPUT_KEY_UP, i, {0, 0}, now);
+            in->sampled_keys[i] = down;
+        }
+    }
+
+    for (int i = 0; i < fz_COUNTOF(input_buttons); ++i) {
+        int down = IsMouseButtonDown(input_buttons[i]);
+        if (down != in->sampled_buttons[i]) {
+            input_push(in, down ? INPUT_BUTTON_DOWN : INPUT_BUTTON_UP, i, {0, 0}, now);
+            in->sampled_buttons[i] = down;
+        }
+    }
+
+    Vector2 mouse = GetMousePosition();
+    if (mouse.x != in->sampled_mouse.x || mouse.y != in->sampled_mouse.y) {
+        input_push(in, INPUT_MOUSE_MOVE, 0, mouse, now);
+        in->sampled_mouse = mouse;
+    }
+
+    in->last_sample = now;
+}
+
+// applies every event sampled up to the deadline, and returns what this tick sees.
+Tick_Input input_consume(Input *in, double deadline) {
+    Tick_Input *held = &in->held;
+    memset(held->keys_pressed,    0, sizeof(held->keys_pressed));
+    memset(held->buttons_pressed, 0, sizeof(held->buttons_pressed));
+
+    while (Input_Event *ev = in->events.peek()) {
+        if (ev->time > deadline) break;
+
+        switch(ev->type) {
+            case INPUT_KEY_DOWN:    held->keys_down[ev->code] = 1; held->keys_pressed[ev->code] += 1; break;
+            case INPUT_KEY_UP:      held->keys_down[ev->code] = 0; break;
+            case INPUT_BUTTON_DOWN: held->buttons_down[ev->code] = 1; held->buttons_pressed[ev->code] += 1; break;
+            case INPUT_BUTTON_UP:   held->buttons_down[ev->code] = 0; break;
+            case INPUT_MOUSE_MOVE:  held->mouse = ev->pos; break;
+        }
+
+        // mouse motion isn't something anyone waits on.
+        if (ev->type != INPUT_MOUSE_MOVE && (!in->pending || ev->time < in->pending_time)) {
+            in->pending          = 1;
+            in->pending_time     = ev->time;
+            in->pending_interval = ev->interval;
         }
+
+        Input_Event done;
+        in->events.pop(&done);
+    }
+
+    return *held;
+}
+
+// right after a frame showing a new Render_State was handed to the display.
+void input_presented(Input *in, const Render_State *rs, double now) {
+    if (rs->input_time == 0) return;
+
+    double ms       = (now - rs->input_time) * 1000.0;
+    double upper_ms = ms + rs->input_interval * 1000.0;
+
+    Input_Latency *l = &in->latency;
+    int bucket = (int)ms;
+    if (bucket > INPUT_LATENCY_MAX) bucket = INPUT_LATENCY_MAX;
+    l->histogram[bucket] += 1;
+    l->count          += 1;
+    l->total_ms       += ms;
+    l->total_upper_ms += upper_ms;
+    if (ms > l->worst_ms) l->worst_ms = ms;
+
+    // the telemetry queue has one producer: the simulation thread, when there is one.
+    if (!sim_thread.running) telemetry_push(TELEMETRY_INPUT_LATENCY, 0, 0, (float)ms, (float)upper_ms);
+}
+
+void input_latency_report(Input *in, FILE *out) {
+    Input_Latency *l = &in->latency;
+    if (!l->count) return;
+
+    uint32_t p50 = 0, p99 = 0, seen = 0;
+    for (int i = 0; i <= INPUT_LATENCY_MAX; ++i) {
+        seen += l->histogram[i];
+        if (!p50 && seen * 2   >= l->count)      p50 = i + 1;
+        if (!p99 && seen * 100 >= l->count * 99) p99 = i + 1;
+    }
+
+    fprintf(out, "[input] %u frames with input: sample->present avg %.2f ms (up to %.2f ms from the actual event), p50 <%u ms, p99 <%u ms, worst %.2f ms\n",
+            l->count, l->total_ms / l->count, l->total_upper_ms / l->count, p50, p99, l->worst_ms);
+    if (in->overflowed) fprintf(out, "[input] %u events dropped: queue full\n", in->overflowed);
+}
+
+// ===================================
+// Replays.
+// --record <file>: a header, then every Tick_Input the game consumed, as is.
+// with the seed and the level that's the whole game: game_tick() only looks at
+// sim and its input, so a fresh sim fed the same inputs plays the same game
+// (--render-replay). recording starts on the title screen, so it doesn't mix
+// with --load-state; the debug rewind and quickload end it (see debug_keys()).
+#define REPLAY_MAGIC   0x50524C4Du // "MLRP"
+#define REPLAY_VERSION 1
+
+struct Replay_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sim;       // SAVE_VERSION: whatever breaks saves breaks replays too.
+    uint32_t level;     // Level::hash.
+    uint64_t seed;
+    uint32_t tick_size; // sizeof(Tick_Input).
+    uint32_t reserved;
+};
+
+struct Replay {
+    FILE    *file;
+    uint32_t ticks;
+};
+
+static Replay replay;
+
+bool replay_start(Replay *r, const char *path, uint64_t seed) {
+    r->file = fopen(path, "wb");
+    if (!r->file) return false;
+
+    Replay_Header header = {};
+    header.magic     = REPLAY_MAGIC;
+    header.version   = REPLAY_VERSION;
+    header.sim       = SAVE_VERSION;
+    header.level     = level.hash;
+    header.seed      = seed;
+    header.tick_size = sizeof(Tick_Input);
+    fwrite(&header, sizeof(header), 1, r->file);
+    r->ticks = 0;
+    return true;
+}
+
+// whichever thread runs the simulation.
+void replay_record(Replay *r, const Tick_Input *in) {
+    if (!r->file) return;
+    fwrite(in, sizeof(*in), 1, r->file);
+    r->ticks += 1;
+}
+
+void replay_stop(Replay *r) {
+    if (!r->file) return;
+    fclose(r->file);
+    r->file = NULL;
+    fprintf(stderr, "[replay] %u ticks recorded\n", r->ticks);
+}
+
+//! @return the file, at the first tick. NULL if it isn't a replay this build can play.
+FILE *replay_open(const char *path, Replay_Header *header) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    if (fread(header, sizeof(*header), 1, file) != 1
+        || header->magic     != REPLAY_MAGIC
+        || header->version   != REPLAY_VERSION
+        || header->sim       != SAVE_VERSION
+        || header->tick_size != sizeof(Tick_Input)) {
+        fclose(file);
+        return NULL;
     }
+    return file;
 }
 
-static Interval enemy_spawn_interval = Interval(1.0);
+// one fixed step, off nothing but `in` and sim: replays feed these back in.
+void game_tick(const Tick_Input *in) {
+    fz_Temp_Block tick_scratch(frame_arena());
+    double tick_begin = telemetry.enabled ? GetTime() : 0;
+    game.tick += 1;
+
+    Event_Queue events(frame_policy());
+    events.reserve(64);
+    tick_events = &events;
 
-void game_update() {
     update_music();
     if (game.camerashake > 0) {
         game.camerashake -= timescaled_dt();
         if (game.camerashake < 0) game.camerashake = 0;
 
-        camera.offset.x = GetRandomValue(1, 50) * game.camerashake;
-        camera.offset.y = GetRandomValue(1, 50) * game.camerashake;
+        camera.offset.x = fz_rng_range(&shake_rng, 1, 50) * game.camerashake;
+        camera.offset.y = fz_rng_range(&shake_rng, 1, 50) * game.camerashake;
     }
 
     if(game.timescale < 1.0) game.timescale += 0.5;
@@ -472,15 +4002,15 @@ void game_update() {
     game.state_change_timer -= timescaled_dt();
     if (game.state_change_timer < 0.0) game.state_change_timer = 0.0;
 
-    int axis_x = (-!!IsKeyDown(KEY_A)) + !!IsKeyDown(KEY_D);
-    int charging = IsMouseButtonDown(MOUSE_LEFT_BUTTON);
-    Vector2 mouse = GetMousePosition();
+    int axis_x = -in->keys_down[INPUT_A] + in->keys_down[INPUT_D];
+    int charging = in->buttons_down[INPUT_LMB];
+    Vector2 mouse = in->mouse;
 
     switch(game.state) {
         case STATE_LEADERBOARD:
         {
             if (game.state_change_timer <= 0.0) {
-                if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
+                if (in->buttons_pressed[INPUT_LMB]) {
                     change_game_state(STATE_PLAYING, 0.5);
                 }
             }
@@ -492,7 +4022,7 @@ void game_update() {
         {
             if (game.state_change_timer <= 0.0) {
                 game.tutorial_happened = 1;
-                if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
+                if (in->buttons_pressed[INPUT_LMB]) {
                     change_game_state(STATE_PLAYING, 0.5);
                 }
             }
@@ -503,10 +4033,10 @@ void game_update() {
         case STATE_PLAYER_DIED:
         {
             if (game.state_change_timer <= 0.0) {
-                if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
+                if (in->buttons_pressed[INPUT_LMB]) {
                     change_game_state(STATE_PLAYING, 0.5);
                 }
-                if (IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
+                if (in->buttons_pressed[INPUT_RMB]) {
                     change_game_state(STATE_LEADERBOARD, 0.5);
                 }
             }
@@ -516,7 +4046,7 @@ void game_update() {
         case STATE_TITLE_SCREEN:
         {
             if (game.state_change_timer <= 0.0) {
-                if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
+                if (in->buttons_pressed[INPUT_LMB]) {
                     change_game_state(game.tutorial_happened ? STATE_PLAYING : STATE_TUTORIAL, 0.5);
                 }
             }
@@ -530,131 +4060,222 @@ void game_update() {
                 if (game.combo_timer > 0) {
                     game.combo_timer -= timescaled_dt();
                     if (game.combo_timer < 0) {
-                        game.score += calc_additional_score();
-
-                        game.combo = 0;
-                        game.additional_score = 0;
-                    }
-                }
-
-                if(interval_tick(&enemy_spawn_interval, timescaled_dt())) {
-                    int id = spawn_entity(ENTITY_ENEMY);
-                    if (id) {
-                        Entity *e = &entities[id];
-                        e->cooldown = GetRandomValue(1, 100) * 0.01;
-                        e->position.x = GetRandomValue((int)(MAP_X_BEGIN + TILE_SIZE), (int)(MAP_X_END - TILE_SIZE));
-                        e->position.y = GetRandomValue((int)(MAP_Y_BEGIN + TILE_SIZE), (int)(MAP_Y_END - TILE_SIZE));
-                        e->target = e->position;
-
-                        PlaySoundMulti(sounds[SOUND_SPAWN_ENEMY]);
+                        emit_event(EVENT_COMBO_END);
                     }
                 }
 
                 update_player_input(axis_x, charging, mouse);
                 if (player.holding_charge) {
-                    Vector2 mline_b, mline_e;
-                    get_magnetbeam_line(&mline_b, &mline_e);
-                    for (int i = 0; i < fz_COUNTOF(grounds); ++i) {
-                        Vector2 gline_b = grounds[i].begin;
-                        Vector2 gline_e = grounds[i].end;
-
-                        if(grounds[i].normal.x == player.normal.x &&
-                           grounds[i].normal.y == player.normal.y)
-                        {
-                            continue;
-                        }
-
-                        Vector2 col;
-                        if (CheckCollisionLines(mline_b, mline_e, gline_b, gline_e, &col)) {
-                            game.hitting_wall = i;
-                            game.hit_pos      = col;
-                            break;
-                        }
+                    Sim_Vec2 mline_b, mline_e;
+                    get_magnetbeam(&mline_b, &mline_e);
+
+                    // the level is float and only says which wall; where on it is sim math.
+                    float    t;
+                    Sim_Vec2 at;
+                    int hit = level_raycast(&level, sim_vector2(mline_b), sim_vector2(mline_e), player.surface, &t);
+                    if (hit != -1 && sim_wall_hit(&level.grounds[hit], mline_b, player.shoot_direction, &at)) {
+                        game.hitting_wall = hit;
+                        game.hit_pos      = at;
                     }
                 }
 
                 do_player_update();
+                timers_advance(sim_dt());
                 update_entities();
             }
         } break;
     }
+
+    drain_events(&events);
+    tick_events = NULL;
+
+    if (telemetry.enabled) {
+        telemetry_push(TELEMETRY_TICK, game.state, sim.entity_count, (float)((GetTime() - tick_begin) * 1000.0));
+    }
+
+    snapshot_capture(&snapshots, &sim);
+}
+
+#if !defined(NDEBUG)
+//! rewind, quick save and quick load. they move the sim from outside, so they
+//! happen here and not in game_tick(): a replay never sees them. a recording
+//! stops at the first rewind or load, since its input can't get there.
+//! @return true when this tick went to rewinding instead.
+bool debug_keys(const Tick_Input *in) {
+    // hold backspace to rewind, one tick per tick.
+    if (in->keys_down[INPUT_BACKSPACE]) {
+        if (replay.file) fprintf(stderr, "[replay] rewound: stopping the recording here\n");
+        replay_stop(&replay);
+        snapshot_restore(&snapshots, 1);
+        return true;
+    }
+
+    // quick save / quick load.
+    if (in->keys_pressed[INPUT_F5]) {
+        if (!savestate_write("quicksave.mlsv")) fprintf(stderr, "[save] could not write quicksave.mlsv\n");
+    }
+    if (in->keys_pressed[INPUT_F9]) {
+        if (savestate_load("quicksave.mlsv")) {
+            if (replay.file) fprintf(stderr, "[replay] quickloaded: stopping the recording here\n");
+            replay_stop(&replay);
+        } else {
+            fprintf(stderr, "[save] quicksave.mlsv is missing or invalid\n");
+        }
+    }
+    return false;
+}
+#endif
+
+// deadline: events sampled up to here belong to this tick.
+void game_update(double deadline) {
+    Tick_Input in = input_consume(&input, deadline);
+#if !defined(NDEBUG)
+    if (debug_keys(&in)) return;
+#endif
+    replay_record(&replay, &in);
+    game_tick(&in);
+}
+
+// everything but the input timing.
+void render_state_fill(Render_State *rs, double time) {
+    rs->tick   = game.tick;
+    rs->time   = time;
+    rs->game   = game;
+    rs->player = player;
+    rs->camera = camera;
+
+    rs->entity_count = sim.entity_count;
+    memcpy(rs->entities, entities, sim.entity_count * sizeof(Entity));
+    for (int i = 0; i < sim.entity_count; ++i) {
+        rs->entity_timers[i] = timer_remaining(entities[i].timer);
+    }
+}
+
+// time: the wall clock the last tick ended on.
+void render_state_publish(double time) {
+    Render_State *rs = render_states.write_slot();
+    render_state_fill(rs, time);
+
+    rs->input_time     = input.pending ? input.pending_time : 0;
+    rs->input_interval = input.pending_interval;
+    input.pending = 0;
+
+    render_states.publish();
+}
+
+// fixed rate, on its own clock. a backlog goes through the same catch-up
+// policy as the single-threaded loop.
+void sim_thread_main(Sim_Thread *t) {
+    thread_frame_arena = &tick_arena;
+
+    double last    = GetTime();
+    double backlog = 0;
+    int    frames  = 0;
+    while (t->running.load(std::memory_order_acquire)) {
+        double now = GetTime();
+        backlog += now - last;
+        last = now;
+
+        int ticks = pacing_ticks(&pacing, &backlog);
+        if (ticks == 0) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(fmin(TICK_SECONDS - backlog, 0.001)));
+            continue;
+        }
+
+        for (int i = 0; i < ticks; ++i) {
+            frame_arena_trim(&tick_arena, &frames);
+            backlog -= TICK_SECONDS;
+            game_update(now);
+            render_state_publish(now - backlog);
+        }
+    }
+}
+
+void sim_thread_start(Sim_Thread *t) {
+    arena_reserve(&tick_arena, FRAME_ARENA_RESERVE, 0, "tick");
+    t->running = true;
+    t->thread  = std::thread(sim_thread_main, t);
 }
 
-void draw_enemy(Entity *e) {
-    DrawCircle(e->position.x, e->position.y, 8, RED);
+void sim_thread_stop(Sim_Thread *t) {
+    if (!t->running) return;
+    t->running.store(false, std::memory_order_release);
+    t->thread.join();
+    fz_arena_release(&tick_arena);
 }
 
-void draw_bullet(Entity *e) {
-    DrawCircleLines(e->position.x, e->position.y, 4, BLACK);
+void draw_enemy(Draw_List *dl, const Entity *e) {
+    push_circle(dl, sim_vector2(e->position), 8, RED);
 }
 
-void draw_death(Entity *e) {
-    float posx = e->position.x;
-    float posy = e->position.y - ((1.0f - e->cooldown) * 10);
-    DrawText("50", posx, posy, 18, BLACK);
+void draw_bullet(Draw_List *dl, const Entity *e) {
+    push_circle_lines(dl, sim_vector2(e->position), 4, BLACK);
 }
 
-void draw_combo_indicator() {
-    float state_delta = (game.state_change_max - game.state_change_timer) / game.state_change_max;
-    Color c = Fade(BLACK, state_delta * (0.1 + (game.combo_timer / 10.0)));
+void draw_death(Draw_List *dl, const Entity *e, float remaining) {
+    Vector2 pos = sim_vector2(e->position);
+    float posx = pos.x;
+    float posy = pos.y - ((1.0f - remaining) * 10);
+    push_text(dl, NULL, "50", {posx, posy}, 18, BLACK);
+}
+
+void draw_combo_indicator(Draw_List *dl, const Render_State *rs) {
+    float state_delta = (rs->game.state_change_max - rs->game.state_change_timer) / rs->game.state_change_max;
+    Color c = Fade(BLACK, state_delta * (0.1 + (rs->game.combo_timer / 10.0)));
 
-    const char *text = TextFormat("%06d", game.score);
-    Vector2 size = MeasureTextEx(bigger_font, text, BIGFONTSIZE, 0);
+    const char *text = frame_format("%06d", rs->game.score);
+    Vector2 size = measure_text(bigger_font, text, BIGFONTSIZE);
 
     float x = MAP_X_CENTER - (size.x * 0.5);
     float y = MAP_Y_CENTER - (size.y * 0.5);
 
-    DrawTextEx(bigger_font, text, {x,y}, BIGFONTSIZE, 0, c);
+    push_text(dl, bigger_font, text, {x,y}, BIGFONTSIZE, c);
     y = MAP_Y_CENTER + (size.y * 0.5);
 
-    if (game.additional_score > 0) {
-        const char *text = TextFormat("+%d", calc_additional_score());
-        Vector2 size = MeasureTextEx(main_font, text, MAINFONTSIZE, 0);
+    if (rs->game.additional_score > 0) {
+        const char *text = frame_format("+%d", calc_additional_score(&rs->game));
+        Vector2 size = measure_text(main_font, text, MAINFONTSIZE);
         float x = MAP_X_CENTER - (size.x * 0.5);
-        DrawTextEx(main_font, text, {x,y}, MAINFONTSIZE, 0, c);
+        push_text(dl, main_font, text, {x,y}, MAINFONTSIZE, c);
 
         y += size.y;
     }
 
-    if (game.combo_timer > 0) {
-        const char *text = TextFormat("%d combo: %01.2f bonus (%01.2f s)", game.combo, combo_multiplier(), game.combo_timer);
-        Vector2 size = MeasureTextEx(main_font, text, MAINFONTSIZE, 0);
+    if (rs->game.combo_timer > 0) {
+        const char *text = frame_format("%d combo: %01.2f bonus (%01.2f s)", rs->game.combo, combo_multiplier(&rs->game), rs->game.combo_timer);
+        Vector2 size = measure_text(main_font, text, MAINFONTSIZE);
         float x = MAP_X_CENTER - (size.x * 0.5);
 
-        DrawTextEx(main_font, text, {x,y}, MAINFONTSIZE, 0, c);
+        push_text(dl, main_font, text, {x,y}, MAINFONTSIZE, c);
     }
 }
 
-void draw_game_screen(RenderTexture2D game_tex) {
-    // ===================================
-    // Inside Render Buffer.
-    BeginTextureMode(game_tex);
-    ClearBackground(WHITE);
-
-    DrawRectangleV(player.pos, player.size, BLACK);
+void build_draw_list(Draw_List *dl, const Render_State *rs) {
+    push_rect(dl, sim_vector2(rs->player.pos), rs->player.size, BLACK);
 
-    for (int i = 0; i < 4; ++i) {
+    for (int i = 0; i < (int)level.grounds.count(); ++i) {
         Color color = BLACK;
-        if (game.hitting_wall == i) {
+        if (rs->game.hitting_wall == i) {
             color = RED;
         }
-        Ground ground = grounds[i];
-        DrawLineEx(ground.begin, ground.end, 4, color);
+        Ground ground = level.grounds[i];
+        push_line(dl, ground.begin, ground.end, 4, color);
     }
-    float state_delta = (game.state_change_max - game.state_change_timer) / game.state_change_max;
+    push_particles(dl, &particles);
+    float state_delta = (rs->game.state_change_max - rs->game.state_change_timer) / rs->game.state_change_max;
 
-    switch(game.state) {
+    switch(rs->game.state) {
         case STATE_TITLE_SCREEN:
         {
             Color c = Fade(BLACK, (state_delta * state_delta));
             const char *text    = "Maglatch";
             const char *subtext = "Click left mouse to begin.";
 
-            Vector2 size = MeasureTextEx(bigger_font, text, BIGFONTSIZE, 0);
+            Vector2 size = measure_text(bigger_font, text, BIGFONTSIZE);
             float x = MAP_X_CENTER - (size.x * 0.5);
             float y = (MAP_Y_CENTER * 0.75) - (size.y * 0.5);
 
-            DrawTextEx(bigger_font, text,    {x,y}, BIGFONTSIZE, 0, c);
+            push_text(dl, bigger_font, text, {x,y}, BIGFONTSIZE, c);
 
             y += size.y;
         } break;
@@ -675,62 +4296,62 @@ void draw_game_screen(RenderTexture2D game_tex) {
 
         case STATE_PLAYER_DIED:
         {
-            Color c = Fade(BLACK, (1.0 - game.state_change_timer));
+            Color c = Fade(BLACK, (1.0 - rs->game.state_change_timer));
             const char *text    = "You died :(";
-            const char *score   = TextFormat("Total Score: %d", game.score);
+            const char *score   = frame_format("Total Score: %d", rs->game.score);
             const char *lmbmessage = "LMB - restart";
             const char *rmbmessage = "RMB - leaderboard";
 
-            Vector2 size = MeasureTextEx(bigger_font, text, BIGFONTSIZE, 0);
+            Vector2 size = measure_text(bigger_font, text, BIGFONTSIZE);
             float x = MAP_X_CENTER - (size.x * 0.5);
             float y = (MAP_Y_CENTER * 0.85) - (size.y * 0.5);
 
-            DrawTextEx(bigger_font, text, {x,y}, BIGFONTSIZE, 0, c);
+            push_text(dl, bigger_font, text, {x,y}, BIGFONTSIZE, c);
 
             y += size.y;
             {
-                Vector2 size = MeasureTextEx(main_font, score, MAINFONTSIZE, 0);
+                Vector2 size = measure_text(main_font, score, MAINFONTSIZE);
                 x = MAP_X_CENTER - (size.x * 0.5);
                 y = MAP_Y_CENTER + size.y * 0.5;
-                DrawTextEx(main_font, score, {x,y}, MAINFONTSIZE, 0, c);
+                push_text(dl, main_font, score, {x,y}, MAINFONTSIZE, c);
                 y += size.y;
             }
 
             {
-                Vector2 size = MeasureTextEx(main_font, lmbmessage, MAINFONTSIZE, 0);
+                Vector2 size = measure_text(main_font, lmbmessage, MAINFONTSIZE);
                 x = MAP_X_CENTER - (size.x * 0.5);
-                DrawTextEx(main_font, lmbmessage, {x,y}, MAINFONTSIZE, 0, c);
+                push_text(dl, main_font, lmbmessage, {x,y}, MAINFONTSIZE, c);
                 y += size.y;
             }
 
             {
-                Vector2 size = MeasureTextEx(main_font, rmbmessage, MAINFONTSIZE, 0);
+                Vector2 size = measure_text(main_font, rmbmessage, MAINFONTSIZE);
                 x = MAP_X_CENTER - (size.x * 0.5);
-                DrawTextEx(main_font, rmbmessage, {x,y}, MAINFONTSIZE, 0, c);
+                push_text(dl, main_font, rmbmessage, {x,y}, MAINFONTSIZE, c);
                 y += size.y;
             }
         } break;
 
         case STATE_LEADERBOARD:
         {
-            Color c = Fade(BLACK, (1.0 - game.state_change_timer));
+            Color c = Fade(BLACK, (1.0 - rs->game.state_change_timer));
             const char *text    = "Top 5 high score";
 
-            Vector2 size = MeasureTextEx(bigger_font, text, BIGFONTSIZE, 0);
+            Vector2 size = measure_text(bigger_font, text, BIGFONTSIZE);
             float x = MAP_X_CENTER - (size.x * 0.5);
             float y = (MAP_Y_CENTER * 0.85) - (size.y * 0.5);
-            DrawTextEx(bigger_font, text, {x,y}, BIGFONTSIZE, 0, c);
+            push_text(dl, bigger_font, text, {x,y}, BIGFONTSIZE, c);
 
             y = (MAP_Y_CENTER) + (size.y * 0.5);
 
             for(int i = 0; i < 5; ++i) {
-                int score = game.high_score[i];
+                int score = rs->game.high_score[i];
                 if (score != 0) {
-                    const char *msg = TextFormat("%d: %06d", i + 1, score);
+                    const char *msg = frame_format("%d: %06d", i + 1, score);
                     {
-                        Vector2 size = MeasureTextEx(main_font, msg, MAINFONTSIZE, 0);
+                        Vector2 size = measure_text(main_font, msg, MAINFONTSIZE);
                         x = MAP_X_CENTER - (size.x * 0.5);
-                        DrawTextEx(main_font, msg, {x,y}, MAINFONTSIZE, 0, c);
+                        push_text(dl, main_font, msg, {x,y}, MAINFONTSIZE, c);
                         y += size.y;
                     }
                 }
@@ -739,98 +4360,585 @@ void draw_game_screen(RenderTexture2D game_tex) {
 
         case STATE_PLAYING:
         {
-            BeginScissorMode(MAP_X_BEGIN, MAP_Y_BEGIN, MAP_SIZE, MAP_SIZE);
-            if(player.charge_amount > 0) {
+            push_scissor(dl, level.min.x, level.min.y, level.max.x - level.min.x, level.max.y - level.min.y);
+            if(rs->player.charge_amount > 0) {
                 Vector2 begin, end;
-                get_magnetbeam_line(&begin, &end);
-                if (game.hitting_wall != -1) {
-                    end = game.hit_pos;
+                get_magnetbeam_line(&begin, &end, &rs->player);
+                if (rs->game.hitting_wall != -1) {
+                    end = sim_vector2(rs->game.hit_pos);
                 }
-                DrawLineEx(begin, end, get_magnetbeam_threshold(), Fade(BLUE, 0.05));
-                DrawLineEx(begin, end, 2, BLUE);
+                push_line(dl, begin, end, get_magnetbeam_threshold(&rs->player), Fade(BLUE, 0.05));
+                push_line(dl, begin, end, 2, BLUE);
             }
 
-            for(int i = 0; i < fz_COUNTOF(entities); ++i) {
-                Entity *e = &entities[i];
+            for(int i = 0; i < rs->entity_count; ++i) {
+                const Entity *e = &rs->entities[i];
                 if (e->being_destroyed) continue;
-                if (e->type == ENTITY_NONE) continue;
 
                 switch(e->type) {
-                    case ENTITY_ENEMY:  draw_enemy(e);  break;
-                    case ENTITY_BULLET: draw_bullet(e); break;
-                    case ENTITY_DEATH: draw_death(e); break;
+                    case ENTITY_ENEMY:  draw_enemy(dl, e);  break;
+                    case ENTITY_BULLET: draw_bullet(dl, e); break;
+                    case ENTITY_DEATH:  draw_death(dl, e, rs->entity_timers[i]);  break;
                 }
             }
             //
             // ===================================
             // Outside Render Buffer.
-            draw_combo_indicator();
-            EndScissorMode();
+            draw_combo_indicator(dl, rs);
+            pop_scissor(dl);
         } break;
     }
-    EndTextureMode();
 }
 
-int main(int argc, char **argv) {
-    InitWindow(1200, 900, "Gravitas");
-    InitAudioDevice();
-    SetTargetFPS(60);
+void draw_game_screen(RenderTexture2D game_tex, const Render_State *rs) {
+    fz_Temp_Block frame_scratch(frame_arena());
+
+    Draw_List dl(frame_policy());
+    dl.reserve(rs->entity_count + 64);
+    build_draw_list(&dl, rs);
+
+    // ===================================
+    // Inside Render Buffer.
+    BeginTextureMode(game_tex);
+    ClearBackground(WHITE);
+    submit_draw_list(&dl);
+    EndTextureMode();
+}
 
+// rng streams, camera, level and player. a replay has to start from exactly
+// the sim the recording did.
+void sim_setup(uint64_t seed, int argc, char **argv) {
     game.timescale = 1;
 
+    fz_Rng root;
+    fz_rng_seed(&root, seed);
+    sim.rng   = fz_rng_split(&root);
+    shake_rng = fz_rng_split(&root);
+    fz_rng_wide_seed(&particles.rng, &root);
+
     camera.zoom = 1;
     camera.rotation = 0;
-    player.normal = { 0, -1 };
     player.size = { TILE_SIZE, TILE_SIZE };
 
-    player.pos.x = MAP_SIZE * 0.5;
-    player.pos.y = MAP_SIZE * 0.5;
+    // --level <file|gen:walls>: the box otherwise.
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (strcmp(argv[i], "--level") != 0) continue;
+
+        const char *arg = argv[i + 1];
+        if (strncmp(arg, "gen:", 4) == 0) {
+            fz_Rng level_rng;
+            fz_rng_seed(&level_rng, atoi(arg + 4));
+            level_generate(&level, atoi(arg + 4), &level_rng);
+        } else if (!level_load(&level, arg)) {
+            fprintf(stderr, "[level] could not load %s\n", arg);
+        }
+    }
+    if (level.grounds.empty()) level_box(&level);
+
+    player.pos     = sim_vec2({ MAP_SIZE * 0.5f, MAP_SIZE * 0.5f });
+    player.surface = level.spawn_surface;
+    player.normal  = level.grounds[player.surface].normal;
+}
+
+// ===================================
+// Headless rendering.
+// --render-replay <replay> <out>: plays a --record file back with no window and
+// no audio device, and writes every frame through the software renderer. out is
+// a .y4m stream ("-" for stdout, to pipe into an encoder), or a PPM sequence if
+// it has a printf pattern in it: frames/%05d.ppm. --render-every <n> keeps one
+// tick in n.
+//
+// each frame is a tick as it ended, no interpolation, and particles step once
+// per tick instead of once per display frame: the same game, at the tick rate.
+struct Frame_Writer {
+    FILE       *file;    // the y4m stream; NULL when writing a sequence.
+    const char *pattern; // the PPM sequence.
+    int         frame;
+    int         width, height;
+};
+
+//! @param fps_num, fps_den frame rate, as a fraction.
+bool frame_writer_open(Frame_Writer *w, const char *path, int width, int height, int fps_num, int fps_den) {
+    w->width  = width;
+    w->height = height;
+    w->frame  = 0;
+    if (strchr(path, '%')) {
+        w->pattern = path;
+        return true;
+    }
+
+    w->file = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    if (!w->file) return false;
+    fprintf(w->file, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg\n", width, height, fps_num, fps_den);
+    return true;
+}
+
+bool frame_writer_write(Frame_Writer *w, const Soft_Renderer *r) {
+    size_t pixels = (size_t)w->width * w->height;
+    w->frame += 1;
+
+    if (w->file) {
+        fputs("FRAME\n", w->file);
+        return fwrite(r->out, 1, pixels * 3 / 2, w->file) == pixels * 3 / 2;
+    }
+
+    char path[512];
+    snprintf(path, sizeof(path), w->pattern, w->frame);
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+
+    fprintf(file, "P6\n%d %d\n255\n", w->width, w->height);
+    bool ok = fwrite(r->out, 1, pixels * 3, file) == pixels * 3;
+    fclose(file);
+    return ok;
+}
+
+void frame_writer_close(Frame_Writer *w) {
+    if (w->file && w->file != stdout) fclose(w->file);
+    else if (w->file) fflush(w->file);
+    w->file = NULL;
+}
+
+//! @return exit code.
+int render_replay(const char *replay_path, const char *out_path, int argc, char **argv) {
+    Replay_Header header;
+    FILE *in = replay_open(replay_path, &header);
+    if (!in) {
+        fprintf(stderr, "[replay] %s is missing, or not a replay this build can play\n", replay_path);
+        return 1;
+    }
+
+    int every = 1;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (strcmp(argv[i], "--render-every") == 0 && atoi(argv[i + 1]) > 0) every = atoi(argv[i + 1]);
+    }
+
+    sim_setup(header.seed, argc, argv);
+    if (level.hash != header.level) {
+        fprintf(stderr, "[replay] %s was recorded on another level; pass the same --level\n", replay_path);
+        fclose(in);
+        return 1;
+    }
+
+    headless = 1;
+    asset_add(ASSET_FONT, "assets/fonts/Poppins-SemiBold.ttf", 0, (void **)&bigger_font, BIGFONTSIZE);
+    asset_add(ASSET_FONT, "assets/fonts/Poppins-Regular.ttf",  0, (void **)&main_font,   MAINFONTSIZE);
+    assets_begin();
+    assets_wait();
+
+    change_game_state(STATE_TITLE_SCREEN, 1.0);
+    snapshot_init(&snapshots, snapshot_memory(), SNAPSHOT_BYTES);
+
+    // 62.5 ticks a second.
+    Frame_Writer writer = {};
+    if (!frame_writer_open(&writer, out_path, 1200, 900, 125, 2 * every)) {
+        fprintf(stderr, "[render] could not open %s\n", out_path);
+        fclose(in);
+        assets_end();
+        fz_arena_release(&snapshot_arena);
+        return 1;
+    }
+
+    Soft_Renderer soft;
+    int workers = (int)std::thread::hardware_concurrency() - 1;
+    soft_init(&soft, 1200, 900, writer.file ? SOFT_OUTPUT_YUV420 : SOFT_OUTPUT_RGB, workers > 0 ? workers : 0);
+
+    static Render_State rs;
+    Tick_Input tick_input;
+    int ticks = 0;
+    auto begin = std::chrono::steady_clock::now();
+
+    while (fread(&tick_input, sizeof(tick_input), 1, in) == 1) {
+        game_tick(&tick_input);
+        ticks += 1;
+
+        Game_Event effect;
+        while (render_effects.pop(&effect)) {
+            particles_emit(&particles, effect.effect, effect.pos, effect.dir);
+        }
+        particles_update(&particles, TICK_SECONDS);
+
+        if (ticks % every) continue;
+
+        fz_Temp_Block frame_scratch(frame_arena());
+        render_state_fill(&rs, ticks * TICK_SECONDS);
+
+        Draw_List dl(frame_policy());
+        dl.reserve(rs.entity_count + 64);
+        build_draw_list(&dl, &rs);
+        soft_render(&soft, &dl, rs.camera.offset);
+
+        if (!frame_writer_write(&writer, &soft)) {
+            fprintf(stderr, "[render] could not write frame %d\n", writer.frame);
+            break;
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    fprintf(stderr, "[render] %d ticks (%.1f s of play), %d frames in %.2f s: %.1fx real time on %d threads\n",
+            ticks, ticks * TICK_SECONDS, writer.frame, seconds, ticks * TICK_SECONDS / fmax(seconds, 1e-6), soft.worker_count + 1);
+
+    frame_writer_close(&writer);
+    soft_destroy(&soft);
+    fclose(in);
+    assets_end();
+    fz_arena_release(&snapshot_arena);
+    return 0;
+}
+
+// ===================================
+// Headless checks.
+// the sim on its own: no window, no assets, no audio device, driven by seeded
+// input instead of a player.
+
+//! a stand-in player: strafes, aims around the arena, holds the beam in bursts
+//! and clicks through the menus. the same rng and the same prev give the same input.
+Tick_Input synthetic_input(fz_Rng *rng, const Tick_Input *prev) {
+    Tick_Input in = {};
+    memcpy(in.keys_down,    prev->keys_down,    sizeof(in.keys_down));
+    memcpy(in.buttons_down, prev->buttons_down, sizeof(in.buttons_down));
+    in.mouse = prev->mouse;
+
+    if (fz_rng_range(rng, 0, 19) == 0) {
+        int axis = fz_rng_range(rng, -1, 1);
+        in.keys_down[INPUT_A] = axis < 0;
+        in.keys_down[INPUT_D] = axis > 0;
+    }
+    if (fz_rng_range(rng, 0, 29) == 0) in.buttons_down[INPUT_LMB] = !in.buttons_down[INPUT_LMB];
+    if (fz_rng_range(rng, 0, 9) == 0) {
+        in.mouse.x = MAP_X_BEGIN + fz_rng_range_f32(rng, 0, MAP_SIZE);
+        in.mouse.y = MAP_Y_BEGIN + fz_rng_range_f32(rng, 0, MAP_SIZE);
+    }
+
+    for (int i = 0; i < (int)fz_COUNTOF(in.keys_down); ++i) {
+        in.keys_pressed[i] = in.keys_down[i] && !prev->keys_down[i];
+    }
+    for (int i = 0; i < (int)fz_COUNTOF(in.buttons_down); ++i) {
+        in.buttons_pressed[i] = in.buttons_down[i] && !prev->buttons_down[i];
+    }
+    return in;
+}
+
+//! sim_setup() for the checks below: --seed (1 when there's none) and --level
+//! as usual, on the title screen with no rewind history. @return the seed.
+uint64_t headless_sim_start(int argc, char **argv) {
+    uint64_t seed = 1;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (strcmp(argv[i], "--seed") == 0) seed = strtoull(argv[i + 1], NULL, 0);
+    }
+    sim_setup(seed, argc, argv);
+
+    headless = 1;
+    change_game_state(STATE_TITLE_SCREEN, 1.0);
+    snapshot_init(&snapshots, snapshot_memory(), SNAPSHOT_BYTES);
+    return seed;
+}
+
+//! fz_fnv1a_32 of everything a save holds.
+uint32_t sim_hash() {
+    fz_Temp_Block scratch(frame_arena());
+    size_t size;
+    uint8_t *block = savestate_build(&size);
+    return fz_fnv1a_32(block, size);
+}
+
+//! --sim-hash <ticks>: plays seeded input with no window and prints the sim's
+//! hash every 1000 ticks and after the last. builds that print the same lines
+//! ran the same game bit for bit: sim_hash.sh compares gcc and clang at -O0 and
+//! -O3 with SIM_FIXED_POINT.
+int sim_hash_run(int ticks, int argc, char **argv) {
+    uint64_t seed = headless_sim_start(argc, argv);
+
+    fz_Rng input_rng;
+    fz_rng_seed(&input_rng, seed);
+    Tick_Input in = {};
+    in.mouse = { MAP_X_CENTER, MAP_Y_CENTER };
+
+    for (int tick = 1; tick <= ticks; ++tick) {
+        in = synthetic_input(&input_rng, &in);
+        game_tick(&in);
+        if (tick % 1000 == 0 || tick == ticks) printf("[hash] tick %6d: %08x\n", tick, sim_hash());
+    }
+
+    fz_arena_release(&snapshot_arena);
+    return 0;
+}
+
+//! --check-savestate <ticks>: every so often, builds a save of the running sim,
+//! opens it, applies it over a scrambled sim and builds again; the two blocks have
+//! to match byte for byte. then plays the same input on from the original and from
+//! the copy, and those two have to match as well. --seed and --level as usual.
+//! @return 0 when every round trip held.
+int check_savestate(int ticks, int argc, char **argv) {
+    const int EVERY = 97;
+    const int AHEAD = 60;
+
+    uint64_t seed = headless_sim_start(argc, argv);
+
+    fz_Rng input_rng;
+    fz_rng_seed(&input_rng, seed);
+    Tick_Input in = {};
+    in.mouse = { MAP_X_CENTER, MAP_Y_CENTER };
+
+    int checked = 0, failed = 0;
+    for (int tick = 1; tick <= ticks; ++tick) {
+        in = synthetic_input(&input_rng, &in);
+        game_tick(&in);
+        if (tick % EVERY) continue;
+
+        fz_Temp_Block scratch(frame_arena());
+        checked += 1;
+
+        size_t size;
+        uint8_t *saved = savestate_build(&size);
+        Save_View view;
+        if (!savestate_open(saved, size, &view)) {
+            fprintf(stderr, "[save] tick %d: could not open a save it just built\n", tick);
+            failed += 1;
+            continue;
+        }
+
+        // camera shake draws from it; cosmetic, so it isn't in the save.
+        fz_Rng     shake    = shake_rng;
+        fz_Rng     rng_from = input_rng;
+        Tick_Input in_from  = in;
+
+        for (int i = 0; i < AHEAD; ++i) {
+            in = synthetic_input(&input_rng, &in);
+            game_tick(&in);
+        }
+        size_t ahead_size;
+        uint8_t *ahead = savestate_build(&ahead_size);
+
+        memset(&sim, 0x5A, sizeof(sim));
+        savestate_apply(&view);
+
+        size_t again_size;
+        uint8_t *again = savestate_build(&again_size);
+        bool ok = true;
+        if (again_size != size || memcmp(again, saved, size) != 0) {
+            fprintf(stderr, "[save] tick %d: applying the save did not give the same state back\n", tick);
+            ok = false;
+        }
+
+        shake_rng = shake;
+        input_rng = rng_from;
+        in        = in_from;
+        for (int i = 0; i < AHEAD; ++i) {
+            in = synthetic_input(&input_rng, &in);
+            game_tick(&in);
+        }
+        size_t replayed_size;
+        uint8_t *replayed = savestate_build(&replayed_size);
+        if (replayed_size != ahead_size || memcmp(replayed, ahead, ahead_size) != 0) {
+            fprintf(stderr, "[save] tick %d: playing on from the save went somewhere else\n", tick);
+            ok = false;
+        }
+        if (!ok) failed += 1;
+        tick += AHEAD;
+    }
+
+    printf("[save] %d round trips, %d failed\n", checked, failed);
+    fz_arena_release(&snapshot_arena);
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    // --bench-level: how level queries scale, then quit.
+    // --bench-sort: fz_sort against std::sort and qsort, then quit.
+    // --bench-alloc: allocators through fz_Allocator and as policies, then quit.
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--bench-level") == 0) {
+            level_benchmark();
+            return 0;
+        }
+        if (strcmp(argv[i], "--bench-sort") == 0) {
+            sort_benchmark();
+            return 0;
+        }
+        if (strcmp(argv[i], "--bench-alloc") == 0) {
+            alloc_benchmark();
+            return 0;
+        }
+    }
+
+    fz_hook_at_alloc(fz_tracked_allocator(&global_alloc_stats, "global", fz_global_allocator));
+
+    heap_guard_inner = fz_global_allocator;
+    fz_Allocator guard = { 0, heap_guard_operation };
+    fz_hook_at_alloc(guard);
 
-    grounds[0].begin  = { MAP_X_BEGIN,  MAP_Y_BEGIN };
-    grounds[0].end    = { MAP_X_END,    MAP_Y_BEGIN };
-    grounds[0].normal = { 0,  1 };
+    arena_reserve(&render_arena, FRAME_ARENA_RESERVE, 0, "render");
 
-    grounds[1].begin  = { MAP_X_BEGIN, MAP_Y_BEGIN };
-    grounds[1].end    = { MAP_X_BEGIN, MAP_Y_END   };
-    grounds[1].normal = { 1, 0 };
+    // --render-replay <replay> <out>: the frames of a recorded game, no window.
+    for (int i = 1; i + 2 < argc; ++i) {
+        if (strcmp(argv[i], "--render-replay") != 0) continue;
 
-    grounds[2].begin = { MAP_X_END,  MAP_Y_BEGIN };
-    grounds[2].end   = { MAP_X_END,  MAP_Y_END   };
-    grounds[2].normal = { -1, 0 };
+        int result = render_replay(argv[i + 1], argv[i + 2], argc, argv);
+        fz_arena_release(&render_arena);
+        fz_alloc_stats_release(&global_alloc_stats);
+        return result;
+    }
+
+    // --check-savestate <ticks>: save round trips on a seeded headless run.
+    // --sim-hash <ticks>: the state hash of one, to compare builds.
+    for (int i = 1; i + 1 < argc; ++i) {
+        int check = strcmp(argv[i], "--check-savestate") == 0;
+        if (!check && strcmp(argv[i], "--sim-hash") != 0) continue;
+
+        int ticks  = atoi(argv[i + 1]);
+        int result = check ? check_savestate(ticks, argc, argv) : sim_hash_run(ticks, argc, argv);
+        fz_arena_release(&render_arena);
+        fz_alloc_stats_release(&global_alloc_stats);
+        return result;
+    }
 
-    grounds[3].begin = { MAP_X_BEGIN,  MAP_Y_END  };
-    grounds[3].end   = { MAP_X_END,    MAP_Y_END  };
-    grounds[3].normal = { 0, -1 };
+    InitWindow(1200, 900, "Gravitas");
+    InitAudioDevice();
+    audio_start(&audio);
 
-    sounds[SOUND_GOT_HIT] = LoadSound("assets/sounds/got_hit.wav");
-    sounds[SOUND_SHOT_BULLET] = LoadSound("assets/sounds/bullet_shot.wav");
-    sounds[SOUND_ENEMY_DIED] = LoadSound("assets/sounds/enemy_died.wav");
-    sounds[SOUND_TELEPORTED] = LoadSound("assets/sounds/teleport.wav");
-    sounds[SOUND_SPAWN_ENEMY] = LoadSound("assets/sounds/enemy_spawn.wav");
-    game_music = LoadMusicStream("assets/sounds/bgm.wav");
+    // --seed <n>: same seed and same input, same game.
+    uint64_t seed = (uint64_t)time(NULL);
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (strcmp(argv[i], "--seed") == 0) seed = strtoull(argv[i + 1], NULL, 0);
+    }
+    sim_setup(seed, argc, argv);
+
+    // fonts first: the title screen needs them.
+    asset_add(ASSET_FONT,  "assets/fonts/Poppins-SemiBold.ttf", 0, (void **)&bigger_font, BIGFONTSIZE);
+    asset_add(ASSET_FONT,  "assets/fonts/Poppins-Regular.ttf",  0, (void **)&main_font,   MAINFONTSIZE);
+    // the sim reads these: with --threaded-sim they have to land before it starts.
+    Asset_Handle sim_assets[6];
+    sim_assets[0] = asset_add(ASSET_SOUND, "assets/sounds/got_hit.wav",     1, (void **)&sounds[SOUND_GOT_HIT]);
+    sim_assets[1] = asset_add(ASSET_SOUND, "assets/sounds/bullet_shot.wav", 1, (void **)&sounds[SOUND_SHOT_BULLET]);
+    sim_assets[2] = asset_add(ASSET_SOUND, "assets/sounds/enemy_died.wav",  1, (void **)&sounds[SOUND_ENEMY_DIED]);
+    sim_assets[3] = asset_add(ASSET_SOUND, "assets/sounds/teleport.wav",    1, (void **)&sounds[SOUND_TELEPORTED]);
+    sim_assets[4] = asset_add(ASSET_SOUND, "assets/sounds/enemy_spawn.wav", 1, (void **)&sounds[SOUND_SPAWN_ENEMY]);
+#if defined(MUSIC_VORBIS)
+    sim_assets[5] = asset_add(ASSET_MUSIC, "assets/sounds/bgm.ogg",         2, (void **)&game_music);
+#else
+    sim_assets[5] = asset_add(ASSET_MUSIC, "assets/sounds/bgm.wav",         2, (void **)&game_music);
+#endif
+    assets_begin();
 
-    float accum = 0;
     RenderTexture2D game_tex = LoadRenderTexture(1200, 900);
     SetTextureFilter(game_tex.texture, TEXTURE_FILTER_BILINEAR);
 
-    main_font = LoadFontEx("assets/fonts/Poppins-Regular.ttf", MAINFONTSIZE, 0, 0);
-    bigger_font = LoadFontEx("assets/fonts/Poppins-SemiBold.ttf", BIGFONTSIZE, 0, 0);
-
     change_game_state(STATE_TITLE_SCREEN, 1.0);
+    snapshot_init(&snapshots, snapshot_memory(), SNAPSHOT_BYTES);
+
+    int loaded = 0;
+    for (int i = 1; i + 1 < argc; ++i) {
+        // --load-state <file>: jump straight into a saved scenario.
+        if (strcmp(argv[i], "--load-state") == 0) {
+            loaded = savestate_load(argv[i + 1]);
+            if (!loaded) fprintf(stderr, "[save] could not load %s\n", argv[i + 1]);
+        }
 
+        // --telemetry <file>: stream per-tick and per-event records.
+        if (strcmp(argv[i], "--telemetry") == 0) {
+            if (!telemetry_start(&telemetry, argv[i + 1])) {
+                fprintf(stderr, "[telemetry] could not open %s\n", argv[i + 1]);
+            }
+        }
+    }
+
+    // --record <file>: every tick's input, for --render-replay.
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (strcmp(argv[i], "--record") != 0) continue;
+
+        if (loaded)                                     fprintf(stderr, "[replay] not recording: replays start from the title screen, not a --load-state\n");
+        else if (!replay_start(&replay, argv[i + 1], seed)) fprintf(stderr, "[replay] could not open %s\n", argv[i + 1]);
+    }
+
+    int threaded = 0;
+    for (int i = 1; i < argc; ++i) {
+        // --threaded-sim: the simulation runs on its own thread at a fixed rate.
+        if (strcmp(argv[i], "--threaded-sim") == 0) threaded = 1;
+
+        // --no-interpolation: draw the latest tick as is.
+        if (strcmp(argv[i], "--no-interpolation") == 0) pacing.interpolate = 0;
+
+        if (i + 1 >= argc) continue;
+
+        // --fps <n>: 0 is uncapped. defaults to the monitor's refresh rate.
+        if (strcmp(argv[i], "--fps") == 0) pacing.target_fps = atoi(argv[i + 1]);
+
+        // --catchup <drop|slow>[:max ticks per frame]
+        if (strcmp(argv[i], "--catchup") == 0) {
+            const char *arg = argv[i + 1];
+            pacing.policy = strncmp(arg, "slow", 4) == 0 ? CATCHUP_SLOW : CATCHUP_DROP;
+
+            const char *colon = strchr(arg, ':');
+            if (colon && atoi(colon + 1) > 0) pacing.max_ticks = atoi(colon + 1);
+        }
+    }
+
+    if (pacing.target_fps < 0) pacing.target_fps = GetMonitorRefreshRate(GetCurrentMonitor());
+    if (pacing.target_fps > 0) SetTargetFPS(pacing.target_fps);
+
+    // something to draw before the first tick.
+    double last_frame = GetTime();
+    double accum      = 0;
+    render_state_publish(last_frame);
+    if (threaded) {
+        // sounds[] and game_music are plain pointers the sim thread reads unlocked.
+        // binding them all here means the thread start publishes them, and nothing
+        // writes them again until assets_end, after sim_thread_stop.
+        for (int i = 0; i < (int)(sizeof(sim_assets) / sizeof(sim_assets[0])); ++i) asset_wait(sim_assets[i]);
+        sim_thread_start(&sim_thread);
+    }
+
+    // from here on, every frame should run off frame_arena alone.
+    heap_guard_armed = 1;
+
+    int frames = 0;
     while(!WindowShouldClose()) {
-        accum += GetFrameTime();
-        while(accum > 0.016) {
-            accum -= 0.016;
-            game_update();
+        frame_arena_trim(&render_arena, &frames);
+
+        double now = GetTime();
+        input_sample(&input, now);
+
+        if (!threaded) {
+            // a tick's deadline is where it ends on the wall clock, plus one tick of lead
+            // so the last tick of a frame picks up this frame's sample.
+            accum += now - last_frame;
+
+            int ticks = pacing_ticks(&pacing, &accum);
+            for (int i = 0; i < ticks; ++i) {
+                accum -= TICK_SECONDS;
+                game_update(now - accum + TICK_SECONDS);
+            }
+            if (ticks) render_state_publish(now - accum);
+        }
+        last_frame = now;
+
+        // keep the state we're leaving: acquire() hands its slot back to the simulation.
+        int fresh = render_states.fresh();
+        if (fresh) {
+            render_state_copy(&render_prev, render_states.read_slot());
+            render_states.acquire();
+        }
+
+        // one tick behind: somewhere between the two latest states.
+        const Render_State *rs = render_states.read_slot();
+        if (pacing.interpolate && render_prev.time > 0 && rs->time > render_prev.time) {
+            float t = (now - TICK_SECONDS - render_prev.time) / (rs->time - render_prev.time);
+            render_state_blend(&render_view, &render_prev, rs, Clamp(t, 0.0f, 1.0f));
+            rs = &render_view;
+        }
 
-            if (accum < 0) accum = 0;
+        Game_Event effect;
+        while (render_effects.pop(&effect)) {
+            particles_emit(&particles, effect.effect, effect.pos, effect.dir);
         }
 
-        draw_game_screen(game_tex);
+        assets_pump();
+        particles_update(&particles, GetFrameTime());
+        draw_game_screen(game_tex, rs);
 
         BeginDrawing();
-        BeginMode2D(camera);
+        BeginMode2D(rs->camera);
         ClearBackground(WHITE);
 
         Rectangle swapped = { 0.0f, 0.0f, (float)game_tex.texture.width, (float)-game_tex.texture.height};
@@ -839,20 +4947,34 @@ int main(int argc, char **argv) {
 
         EndMode2D();
         EndDrawing();
+        if (fresh) input_presented(&input, rs, GetTime());
+    }
+
+    sim_thread_stop(&sim_thread);
+    replay_stop(&replay);
+    if (pacing.capped_frames) {
+        fprintf(stderr, "[pacing] %u frames hit the catch-up cap, %u ticks dropped\n", pacing.capped_frames, pacing.dropped_ticks);
     }
 
-    UnloadFont(main_font);
-    UnloadFont(bigger_font);
     UnloadRenderTexture(game_tex);
 
-    UnloadSound(sounds[SOUND_GOT_HIT]);
-    UnloadSound(sounds[SOUND_SHOT_BULLET]);
-    UnloadSound(sounds[SOUND_ENEMY_DIED]);
-    UnloadSound(sounds[SOUND_TELEPORTED]);
-    UnloadSound(sounds[SOUND_SPAWN_ENEMY]);
-    UnloadMusicStream(game_music);
+    input_latency_report(&input, stderr);
+    audio_stop(&audio);
+    assets_end();
 
     CloseAudioDevice();
     CloseWindow();
+
+    heap_guard_armed = 0;
+    telemetry_stop(&telemetry);
+    fz_arena_release(&snapshot_arena);
+    fz_arena_release(&render_arena);
+
+    // static, so it would outlive the report: only real leaks should show up there.
+    level.grounds.release();
+    level.nodes.release();
+
+    fz_alloc_stats_report(&global_alloc_stats, stdout);
+    fz_alloc_stats_release(&global_alloc_stats);
     return 0;
 }
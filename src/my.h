@@ -122,9 +122,18 @@ enum fz_Memory_Operation {
 //! @param ptr       non-null existing pointer for free, or realloc.
 //! @param old_size  size for limitation on memmove when reallocating. only used for realloc, otherwise 0.
 //! @param size      non-zero size for allocating new memory, or reallocating different size of memory.
+//! @param alignment power of two the returned pointer is aligned to. only used for alloc and realloc, otherwise 0.
 //! @param user_data typically points to an allocator.
 //! @return pointer to newly allocated memory, or NULL if free.
-#define fz_OPER_FUNC(name) void *name(fz_Memory_Operation op, void *ptr, size_t old_size, size_t size, void *user_data)
+#define fz_OPER_FUNC(name) void *name(fz_Memory_Operation op, void *ptr, size_t old_size, size_t size, size_t alignment, void *user_data)
+
+// what every allocation is aligned to unless it asks for more.
+#ifndef fz_PUSH_ALIGNMENT
+#define fz_PUSH_ALIGNMENT 16
+#endif
+
+// align per-thread data to this so two threads never write the same line.
+#define fz_CACHE_LINE 64
 
 typedef fz_OPER_FUNC(fz_Oper_Func);
 
@@ -136,6 +145,7 @@ struct fz_Allocator {
 extern fz_Allocator fz_global_allocator;
 extern fz_Allocator fz_global_temp_allocator;
 
+fz_DEF fz_Allocator fz_set_allocator(fz_Allocator new_allocator);
 fz_DEF fz_Allocator fz_hook_at_alloc(fz_Allocator new_allocator);
 fz_DEF fz_Allocator fz_set_temp_allocator(fz_Allocator new_allocator);
 
@@ -153,19 +163,30 @@ fz_DEF fz_Allocator fz_set_temp_allocator(fz_Allocator new_allocator);
 #define fz_talloc(size) (fz_alloc_ex(fz_global_temp_allocator, size))
 #define fz_tfree(ptr)   (fz_free_ex(fz_global_temp_allocator, ptr))
 
+inline void *
+fz_alloc_aligned(fz_Allocator allocator, size_t size, size_t alignment) {
+    return allocator.oper_func(fz_MEMORY_OPER_ALLOCATE, 0, 0, size, alignment, allocator.user_data);
+}
+
+//! @param alignment must be the same one ptr was allocated with.
+inline void *
+fz_realloc_aligned(fz_Allocator allocator, void *ptr, size_t old_size, size_t size, size_t alignment) {
+    return allocator.oper_func(fz_MEMORY_OPER_REALLOCATE, ptr, old_size, size, alignment, allocator.user_data);
+}
+
 inline void *
 fz_alloc_ex(fz_Allocator allocator, size_t size) {
-    return allocator.oper_func(fz_MEMORY_OPER_ALLOCATE, 0, 0, size, allocator.user_data);
+    return fz_alloc_aligned(allocator, size, fz_PUSH_ALIGNMENT);
 }
 
 inline void
 fz_free_ex(fz_Allocator allocator, void *ptr) {
-    allocator.oper_func(fz_MEMORY_OPER_FREE, ptr, 0, 0, allocator.user_data);
+    allocator.oper_func(fz_MEMORY_OPER_FREE, ptr, 0, 0, 0, allocator.user_data);
 }
 
 inline void *
 fz_realloc_ex(fz_Allocator allocator, void *ptr, size_t old_size, size_t size) {
-    return allocator.oper_func(fz_MEMORY_OPER_REALLOCATE, ptr, old_size, size, allocator.user_data);
+    return fz_realloc_aligned(allocator, ptr, old_size, size, fz_PUSH_ALIGNMENT);
 }
 
 inline uintptr_t
@@ -211,7 +232,7 @@ fz_DEF void fz__vec_sort(void *array, size_t element_size, fz_COMPARATOR_FUNC co
 #define fz_Vec_Header(array)   ((fz_Array_Header_Type *)(array) - 1)
 #define fz_Vec_Length(array)   ((array) ? fz_Vec_Header(array)->used : 0)
 #define fz_Vec_Capacity(array) ((array) ? fz_Vec_Header(array)->caps : 0)
-#define fz_Vec_SetLength(array, len) ((array) && (fz_Vec_Length(array) < len) && (fz_Vec_Capacity(array) < len) ? (fz_Vec_Header(array)->used = len) : 0)
+#define fz_Vec_SetLength(array, len) ((array) && ((size_t)(len) <= (size_t)fz_Vec_Capacity(array)) ? (fz_Vec_Header(array)->used = (len)) : 0)
 
 // Internals
 #define _FV_GROW(arr, sz)  (fz__vec_grow((void **)&(arr), fz_Vec_Header(arr), sizeof(arr[0]), sz))
@@ -298,10 +319,31 @@ fz_DEF void *fz_platform_alloc(size_t size);
 fz_DEF void *fz_platform_realloc(void *ptr, size_t size);
 fz_DEF void  fz_platform_free(void *ptr);
 
+// alignment is a power of two. both are released with fz_platform_free.
+fz_DEF void *fz_platform_alloc_aligned(size_t size, size_t alignment);
+fz_DEF void *fz_platform_realloc_aligned(void *ptr, size_t old_size, size_t size, size_t alignment);
+
+// virtual memory: reserve address space first, commit pages inside it later.
+// ptr and size of commit/decommit are multiples of fz_platform_page_size(),
+// or of fz_HUGE_PAGE_SIZE for huge pages.
+#define fz_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+enum {
+    fz_PAGES_HUGE          = 1 << 0, // transparent huge pages, where the OS has them.
+    fz_PAGES_EXPLICIT_HUGE = 1 << 1, // preallocated huge pages (hugetlbfs); plain pages when there are none left.
+};
+
+fz_DEF size_t fz_platform_page_size(void);
+fz_DEF void  *fz_platform_reserve(size_t size, uint32_t pages);
+fz_DEF int    fz_platform_commit(void *ptr, size_t size, uint32_t pages);
+fz_DEF void   fz_platform_decommit(void *ptr, size_t size);
+fz_DEF void   fz_platform_release(void *ptr, size_t size);
+
 inline fz_OPER_FUNC(fz_nil_operation) {
     fz_UNUSED(op);
     fz_UNUSED(ptr);
     fz_UNUSED(size);
+    fz_UNUSED(alignment);
     fz_UNUSED(user_data);
     return NULL;
 }
@@ -326,10 +368,25 @@ fz_DEF fz_Allocator fz_heap_allocator();
  * ==================================================
  * */
 
+// fz_arena_init: a fixed block from the caller, all of it usable from the start.
+// fz_arena_init_virtual: a reserved address range that commits pages as `used`
+// grows into it. pointers never move, and capacity is only a limit on address
+// space. fz_arena_reset gives back whatever was committed past both
+// keep_committed and the high water mark since the last reset, so calling it
+// now and then between frames trims what one busy frame left behind.
+#define fz_ARENA_COMMIT_STEP    (64 * 1024)
+#define fz_ARENA_KEEP_COMMITTED (1024 * 1024)
+
 struct fz_Arena {
     uint8_t *memory;
     size_t   capacity;
     size_t   used;
+
+    size_t   committed;      // == capacity for a fixed arena.
+    size_t   high_water;     // the most used since the last fz_arena_reset.
+    size_t   keep_committed; // virtual: what fz_arena_reset leaves committed.
+    uint32_t pages;          // virtual: fz_PAGES_ flags; 0 for a fixed arena.
+    int      is_virtual;
 };
 
 struct fz_Temp_Memory {
@@ -339,6 +396,13 @@ struct fz_Temp_Memory {
 
 fz_DEF void fz_arena_init(fz_Arena *arena, void *backing_memory, size_t memory_size);
 
+//! @param reserve_size address space to set aside. nothing is committed until it's used.
+//! @param pages        fz_PAGES_ flags, or 0.
+//! @return 0 if the range couldn't be reserved.
+fz_DEF int  fz_arena_init_virtual(fz_Arena *arena, size_t reserve_size, uint32_t pages);
+fz_DEF void fz_arena_reset(fz_Arena *arena);
+fz_DEF void fz_arena_release(fz_Arena *arena);
+
 fz_DEF fz_OPER_FUNC(fz_arena_operation);
 
 fz_DEF fz_Allocator   fz_arena_allocator(fz_Arena *arena);
@@ -378,7 +442,8 @@ fz_DEF fz_OPER_FUNC(fz_stack_operation);
  * ==================================================
  * */
 
-// TODO
+// init touches nothing: elements are bumped off the untouched end first,
+// and only the ones freed since go through the free list.
 struct fz_SLL_Header {
     fz_SLL_Header *next;
 };
@@ -386,11 +451,19 @@ struct fz_SLL_Header {
 struct fz_Pool {
     uint8_t *base;
     size_t element_size;
+    size_t stride;      // element_size rounded up to alignment; the distance between two elements.
+    size_t alignment;
     size_t memory_caps; // The total size of memory capacity. NOT the count of total usable chunk.
+    size_t capacity;    // elements that fit.
+    size_t bumped;      // elements ever handed out from the untouched end. the rest was never written.
+    int    zero_memory; // clear elements on alloc. on by default; turn off when the caller writes every field.
     fz_SLL_Header *free;
 };
 
 fz_DEF void fz_pool_init(fz_Pool *pool, void *backing_memory, size_t memory_size, size_t element_size);
+//! every element starts on alignment. pass fz_CACHE_LINE to give each element lines of its own.
+fz_DEF void fz_pool_init_aligned(fz_Pool *pool, void *backing_memory, size_t memory_size, size_t element_size, size_t alignment);
+fz_DEF void fz_pool_reset(fz_Pool *pool); // frees every element at once.
 fz_DEF fz_Allocator fz_pool_allocator(fz_Pool *pool);
 
 fz_DEF fz_OPER_FUNC(fz_pool_operation);
@@ -401,8 +474,11 @@ fz_DEF fz_OPER_FUNC(fz_pool_operation);
  * ==================================================
  * */
 
+// the word right before a pointer handed out is always its offset back to the header;
+// that's `offset` itself unless the allocation asked for more than fz_PUSH_ALIGNMENT.
 struct fz_SizeHeader {
     size_t size;
+    size_t offset;
 };
 
 struct fz_ListNode {
@@ -441,6 +517,107 @@ fz_OPER_FUNC(fz_ring_operation);
 fz_DEF void fz_ring_init(fz_Ring *freelist, void *backing_memory, size_t memory_size);
 fz_DEF fz_Allocator fz_ring_allocator(fz_Ring *ring);
 
+/*
+ * ==================================================
+ * Allocator Instrumentation.
+ * wraps any allocator and records what goes through it.
+ * only compiled in with fz_ALLOC_STATS defined; otherwise fz_tracked_allocator
+ * hands back the inner allocator untouched and the report does nothing.
+ *
+ * usage:
+ *     static fz_Alloc_Stats stats;
+ *     fz_hook_at_alloc(fz_tracked_allocator(&stats, "global", fz_global_allocator));
+ *     ...
+ *     fz_alloc_stats_report(&stats, stdout);
+ *
+ * NOTE(fuzzy): not thread-safe. wrap one allocator per thread.
+ * ==================================================
+ * */
+
+#if defined(fz_ALLOC_STATS)
+
+#if defined(__cplusplus)
+#define fz_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define fz_THREAD_LOCAL __declspec(thread)
+#else
+#define fz_THREAD_LOCAL _Thread_local
+#endif
+
+#define fz_ALLOC_HISTOGRAM_BUCKETS 32 // bucket i holds sizes in (2^(i-1), 2^i].
+#define fz_ALLOC_MAX_SITES         128
+
+struct fz_Alloc_Site {
+    const char *site;  // fz_FILE_AND_LINE of the caller.
+    size_t      count;
+    size_t      bytes;
+    size_t      live_bytes;
+};
+
+struct fz_Alloc_Entry {
+    void       *ptr;
+    size_t      size;
+    const char *site;
+};
+
+struct fz_Alloc_Stats {
+    const char  *name;
+    fz_Allocator inner;
+
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t total_bytes;
+
+    size_t live_count;
+    size_t alloc_count;
+    size_t realloc_count;
+    size_t free_count;
+
+    size_t histogram[fz_ALLOC_HISTOGRAM_BUCKETS];
+
+    fz_Alloc_Site sites[fz_ALLOC_MAX_SITES];
+    int           site_count;
+    fz_Alloc_Site other_sites; // catches every site past the first fz_ALLOC_MAX_SITES.
+
+    // open addressing table of live blocks, so free() knows the size it releases.
+    // lives on the platform heap, never on the tracked allocator.
+    fz_Alloc_Entry *entries;
+    size_t          entry_caps;
+};
+
+// set by the allocation macros right before calling into the allocator.
+extern fz_THREAD_LOCAL const char *fz__alloc_site;
+
+fz_DEF fz_Allocator fz_tracked_allocator(fz_Alloc_Stats *stats, const char *name, fz_Allocator inner);
+fz_DEF void         fz_alloc_stats_report(fz_Alloc_Stats *stats, FILE *out);
+fz_DEF void         fz_alloc_stats_release(fz_Alloc_Stats *stats);
+
+fz_DEF fz_OPER_FUNC(fz_tracked_operation);
+
+// attribute every allocation to the line that asked for it.
+#define fz_alloc_ex(allocator, size)                    (fz__alloc_site = fz_FILE_AND_LINE, fz_alloc_ex((allocator), (size)))
+#define fz_realloc_ex(allocator, ptr, old_size, size)   (fz__alloc_site = fz_FILE_AND_LINE, fz_realloc_ex((allocator), (ptr), (old_size), (size)))
+#define fz_alloc_aligned(allocator, size, alignment)    (fz__alloc_site = fz_FILE_AND_LINE, fz_alloc_aligned((allocator), (size), (alignment)))
+#define fz_realloc_aligned(allocator, ptr, old_size, size, alignment) \
+    (fz__alloc_site = fz_FILE_AND_LINE, fz_realloc_aligned((allocator), (ptr), (old_size), (size), (alignment)))
+
+#else
+
+struct fz_Alloc_Stats {
+    int empty;
+};
+
+inline fz_Allocator fz_tracked_allocator(fz_Alloc_Stats *stats, const char *name, fz_Allocator inner) {
+    fz_UNUSED(stats);
+    fz_UNUSED(name);
+    return inner;
+}
+
+inline void fz_alloc_stats_report(fz_Alloc_Stats *stats, FILE *out)  { fz_UNUSED(stats); fz_UNUSED(out); }
+inline void fz_alloc_stats_release(fz_Alloc_Stats *stats)            { fz_UNUSED(stats); }
+
+#endif // fz_ALLOC_STATS
+
 #else  // if !defined(fz_MINIMAL_FOOTPRINT) {...above block...} else
 
 fz_DEF void *xmalloc(size_t size);
@@ -450,6 +627,285 @@ fz_DEF void *xcalloc(size_t size, size_t count);
 
 #endif // fz_MINIMAL_FOOTPRINT ( 113 )
 
+/*
+ * ==================================================
+ * Delta compression.
+ * XOR of two blocks of the same size, with runs of unchanged 8 byte words skipped.
+ * XOR is its own inverse: the same delta takes prev -> curr, and curr -> prev.
+ *
+ * layout: { uint32 skip_words; uint32 literal_words; uint64 xor[literal_words]; } ...
+ * ==================================================
+ * */
+
+//! @return worst case size of a delta for a block of `size` bytes.
+fz_DEF size_t fz_delta_bound(size_t size);
+
+//! writes the delta between prev and curr into out, and updates prev to curr
+//! (only the changed words are written back).
+//! @return bytes written into out. 0 means both blocks were identical.
+fz_DEF size_t fz_delta_capture(void *prev, const void *curr, size_t size, void *out, size_t out_caps);
+
+//! XORs a delta into block.
+fz_DEF void fz_delta_apply(void *block, size_t size, const void *delta, size_t delta_size);
+
+/*
+ * ==================================================
+ * Hashing.
+ * ==================================================
+ * */
+
+inline uint32_t fz_fnv1a_32(const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint32_t hash = 0x811C9DC5u;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x01000193u;
+    }
+    return hash;
+}
+
+/*
+ * ==================================================
+ * File Mapping.
+ * read-only view of a whole file. mmap / MapViewOfFile where possible;
+ * falls back to reading it into the heap when the platform headers aren't available.
+ * ==================================================
+ * */
+
+struct fz_File_Map {
+    void  *data;
+    size_t size;
+
+    int    mapped; // 0: data came from malloc.
+    intptr_t handle;
+};
+
+//! @return map with data == NULL if the file could not be opened.
+fz_DEF fz_File_Map fz_file_map(const char *path);
+fz_DEF void        fz_file_unmap(fz_File_Map *map);
+
+/*
+ * ==================================================
+ * Random.
+ * generators with explicit state: nothing global, nothing shared between
+ * threads, and the same sequence on every platform.
+ *
+ * fz_Rng (xoshiro256**) is the workhorse. fz_rng_jump() skips 2^128 draws,
+ * so fz_rng_split() can hand out independent streams per subsystem or
+ * worker from one seed.
+ * fz_Pcg32 is the small one (16 bytes, 2^63 streams by `stream`), for state
+ * that gets copied around a lot.
+ * fz_Rng_Wide runs fz_RNG_LANES xoshiro streams side by side for bulk
+ * draws; SSE2 when available, same numbers either way.
+ *
+ * usage:
+ *     fz_Rng root;   fz_rng_seed(&root, seed);
+ *     fz_Rng gameplay = fz_rng_split(&root);
+ *     int roll = fz_rng_range(&gameplay, 1, 6);
+ * ==================================================
+ * */
+
+#define fz_RNG_LANES 4
+
+typedef struct fz_Rng {
+    uint64_t s[4];
+} fz_Rng;
+
+typedef struct fz_Pcg32 {
+    uint64_t state;
+    uint64_t inc;
+} fz_Pcg32;
+
+typedef struct fz_Rng_Wide {
+    uint64_t s[4][fz_RNG_LANES]; // [word][lane], so neighbouring lanes load together.
+} fz_Rng_Wide;
+
+fz_DEF void   fz_rng_seed(fz_Rng *rng, uint64_t seed);
+fz_DEF void   fz_rng_jump(fz_Rng *rng);      // 2^128 draws ahead.
+fz_DEF void   fz_rng_long_jump(fz_Rng *rng); // 2^192 draws ahead.
+//! @return a stream starting where rng is now; rng itself jumps past it.
+fz_DEF fz_Rng fz_rng_split(fz_Rng *rng);
+
+fz_DEF void fz_pcg32_seed(fz_Pcg32 *rng, uint64_t seed, uint64_t stream);
+fz_DEF void fz_pcg32_advance(fz_Pcg32 *rng, uint64_t delta); // O(log delta).
+
+// every lane is split off `from`.
+fz_DEF void fz_rng_wide_seed(fz_Rng_Wide *wide, fz_Rng *from);
+// lanes are drawn round robin, two 32-bit halves per draw, in blocks of 2 * fz_RNG_LANES;
+// what's left of the last block is thrown away.
+fz_DEF void fz_rng_wide_fill_u32(fz_Rng_Wide *wide, uint32_t *out, size_t count);
+fz_DEF void fz_rng_wide_fill_f32(fz_Rng_Wide *wide, float *out, size_t count); // [0, 1)
+
+inline uint64_t fz_rng_next(fz_Rng *rng) {
+    uint64_t *s = rng->s;
+    uint64_t x = s[1] * 5;
+    uint64_t result = ((x << 7) | (x >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+
+    return result;
+}
+
+inline uint32_t fz_rng_u32(fz_Rng *rng) {
+    return (uint32_t)(fz_rng_next(rng) >> 32);
+}
+
+// [0, 1)
+inline float fz_rng_f32(fz_Rng *rng) {
+    return (float)(fz_rng_next(rng) >> 40) * (1.0f / 16777216.0f);
+}
+
+inline float fz_rng_range_f32(fz_Rng *rng, float lo, float hi) {
+    return lo + (hi - lo) * fz_rng_f32(rng);
+}
+
+// [lo, hi], both ends included (like GetRandomValue). no modulo bias.
+inline int32_t fz_rng_range(fz_Rng *rng, int32_t lo, int32_t hi) {
+    if (lo > hi) { int32_t t = lo; lo = hi; hi = t; }
+
+    uint32_t span = (uint32_t)hi - (uint32_t)lo + 1;
+    if (span == 0) return (int32_t)fz_rng_u32(rng);
+
+    uint64_t m = (uint64_t)fz_rng_u32(rng) * span;
+    if ((uint32_t)m < span) {
+        uint32_t threshold = (0u - span) % span;
+        while ((uint32_t)m < threshold) m = (uint64_t)fz_rng_u32(rng) * span;
+    }
+    return (int32_t)((uint32_t)lo + (uint32_t)(m >> 32));
+}
+
+inline uint32_t fz_pcg32_next(fz_Pcg32 *rng) {
+    uint64_t old = rng->state;
+    rng->state = old * 6364136223846793005ull + rng->inc;
+
+    uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+    uint32_t rot = (uint32_t)(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31));
+}
+
+inline float fz_pcg32_f32(fz_Pcg32 *rng) {
+    return (float)(fz_pcg32_next(rng) >> 8) * (1.0f / 16777216.0f);
+}
+
+/*
+ * ==================================================
+ * Fixed point.
+ * Q16.16 in an int32: integer adds, multiplies and shifts only, so the same
+ * inputs give the same bits on every compiler, optimization level and CPU --
+ * no FMA contraction, no excess precision, no libm. range is +-32768 in
+ * steps of 1/65536.
+ *
+ * the value is wrapped in a struct so it can't be mixed with plain ints by
+ * accident; .raw is the bits. multiplies round toward -inf, divides toward 0,
+ * adds wrap on overflow.
+ *
+ * usage:
+ *     fz_Fixed2 pos = { fz_fixed_from_int(10), fz_fixed_from_int(20) };
+ *     pos = fz_fixed2_add(pos, fz_fixed2_scale(dir, speed));
+ *     DrawCircle(fz_fixed_to_float(pos.x), fz_fixed_to_float(pos.y), ...);
+ * ==================================================
+ * */
+
+#define fz_FIXED_BITS 16
+#define fz_FIXED_ONE  (1 << fz_FIXED_BITS)
+
+typedef struct fz_Fixed {
+    int32_t raw;
+} fz_Fixed;
+
+typedef struct fz_Fixed2 {
+    fz_Fixed x;
+    fz_Fixed y;
+} fz_Fixed2;
+
+fz_DEF fz_Fixed fz_fixed_sqrt(fz_Fixed a);       // a >= 0; rounds down.
+fz_DEF fz_Fixed fz_fixed2_length(fz_Fixed2 a);   // doesn't overflow for any a.
+// pos[i] += dir[i] * scale, bit for bit what fz_fixed2_scale() would give.
+// SSE2 when available: two vectors per instruction, no int64 in sight.
+fz_DEF void fz_fixed2_advance(fz_Fixed2 *pos, const fz_Fixed2 *dir, fz_Fixed scale, size_t count);
+
+inline fz_Fixed fz_fixed_raw(int32_t raw) {
+    fz_Fixed r = { raw };
+    return r;
+}
+
+inline fz_Fixed fz_fixed_from_int(int32_t i) {
+    return fz_fixed_raw((int32_t)((uint32_t)i << fz_FIXED_BITS));
+}
+
+// rounds to nearest. the one place a float goes in: f * 65536 and the + 0.5
+// are both exact in a double, so this is deterministic too.
+inline fz_Fixed fz_fixed_from_float(float f) {
+    double d = (double)f * fz_FIXED_ONE;
+    return fz_fixed_raw((int32_t)(d < 0 ? d - 0.5 : d + 0.5));
+}
+
+inline float fz_fixed_to_float(fz_Fixed a) {
+    return (float)a.raw * (1.0f / fz_FIXED_ONE);
+}
+
+inline fz_Fixed fz_fixed_add(fz_Fixed a, fz_Fixed b) {
+    return fz_fixed_raw((int32_t)((uint32_t)a.raw + (uint32_t)b.raw));
+}
+
+inline fz_Fixed fz_fixed_sub(fz_Fixed a, fz_Fixed b) {
+    return fz_fixed_raw((int32_t)((uint32_t)a.raw - (uint32_t)b.raw));
+}
+
+inline fz_Fixed fz_fixed_mul(fz_Fixed a, fz_Fixed b) {
+    return fz_fixed_raw((int32_t)(((int64_t)a.raw * b.raw) >> fz_FIXED_BITS));
+}
+
+inline fz_Fixed fz_fixed_div(fz_Fixed a, fz_Fixed b) {
+    assert(b.raw != 0);
+    return fz_fixed_raw((int32_t)(((int64_t)a.raw * fz_FIXED_ONE) / b.raw));
+}
+
+inline fz_Fixed fz_fixed_lerp(fz_Fixed a, fz_Fixed b, fz_Fixed t) {
+    return fz_fixed_add(a, fz_fixed_mul(fz_fixed_sub(b, a), t));
+}
+
+inline fz_Fixed2 fz_fixed2_add(fz_Fixed2 a, fz_Fixed2 b) {
+    fz_Fixed2 r = { fz_fixed_add(a.x, b.x), fz_fixed_add(a.y, b.y) };
+    return r;
+}
+
+inline fz_Fixed2 fz_fixed2_sub(fz_Fixed2 a, fz_Fixed2 b) {
+    fz_Fixed2 r = { fz_fixed_sub(a.x, b.x), fz_fixed_sub(a.y, b.y) };
+    return r;
+}
+
+inline fz_Fixed2 fz_fixed2_scale(fz_Fixed2 a, fz_Fixed s) {
+    fz_Fixed2 r = { fz_fixed_mul(a.x, s), fz_fixed_mul(a.y, s) };
+    return r;
+}
+
+// summed at full width, rounded once. the result has to fit: two 200 long
+// vectors already don't, use fz_fixed2_length() for distances.
+inline fz_Fixed fz_fixed2_dot(fz_Fixed2 a, fz_Fixed2 b) {
+    int64_t d = (int64_t)a.x.raw * b.x.raw + (int64_t)a.y.raw * b.y.raw;
+    return fz_fixed_raw((int32_t)(d >> fz_FIXED_BITS));
+}
+
+inline fz_Fixed2 fz_fixed2_lerp(fz_Fixed2 a, fz_Fixed2 b, fz_Fixed t) {
+    fz_Fixed2 r = { fz_fixed_lerp(a.x, b.x, t), fz_fixed_lerp(a.y, b.y, t) };
+    return r;
+}
+
+// zero stays zero.
+inline fz_Fixed2 fz_fixed2_normalize(fz_Fixed2 a) {
+    fz_Fixed len = fz_fixed2_length(a);
+    if (len.raw == 0) return a;
+    fz_Fixed2 r = { fz_fixed_div(a.x, len), fz_fixed_div(a.y, len) };
+    return r;
+}
+
 #if defined(__cplusplus)
 }
 #endif
@@ -458,6 +914,10 @@ fz_DEF void *xcalloc(size_t size, size_t count);
  // Everything below is a C++ feature.
 
 #if defined(__cplusplus)
+#include <new>         // placement new
+#include <utility>     // std::move, std::forward
+#include <type_traits> // std::is_trivially_copyable
+
 #if !defined(fz_MINIMAL_FOOTPRINT)
 struct fz_Temp_Block {
     fz_Temp_Memory tm;
@@ -494,6 +954,1080 @@ struct fz_ScopeExit_Help {
 
 #define fz_scopeexit auto fz_CONCAT(FZ_SCOPEEXIT_, __LINE__) = fz_ScopeExit_Help() + [&]
 
+#if !defined(fz_MINIMAL_FOOTPRINT)
+/*
+ * ==================================================
+ * Allocator Policies.
+ * the same allocators as above, but as types: a container that takes its
+ * policy as a template parameter calls it directly, so the bump of an arena
+ * or the pop of a pool inlines into the loop instead of going through
+ * oper_func and a switch every time.
+ *
+ * a policy is a small handle with
+ *     void *allocate(size_t size, size_t alignment);
+ *     void *reallocate(void *ptr, size_t old_size, size_t size, size_t alignment);
+ *     void  deallocate(void *ptr);
+ *
+ * fz_Dynamic_Policy wraps any fz_Allocator (that's the default everywhere),
+ * and fz_policy_allocator() goes the other way for code that wants an fz_Allocator.
+ * policies convert from what they wrap, so containers take that directly.
+ *
+ * usage:
+ *     fz_Array<Draw_Cmd, 0, fz_Arena_Policy> cmds(&arena);
+ *     fz_Allocator erased = fz_policy_allocator(&pool_policy);
+ * ==================================================
+ * */
+
+// what fz_alloc_stats_report lists container allocations under: the policy
+// can't see which line pushed, so they all share this one site.
+#define fz_CONTAINER_SITE "(containers: fz_Array and other fz_Dynamic_Policy users)"
+
+// default built, it holds no allocator and asks for fz_global_allocator on every
+// call: a static container made before main() still goes through whatever hook
+// (fz_tracked_allocator, a heap guard) is installed by the time it allocates.
+struct fz_Dynamic_Policy {
+    fz_Allocator allocator; // oper_func NULL: fz_global_allocator, looked up per call.
+
+    fz_Dynamic_Policy(): allocator() {}
+    fz_Dynamic_Policy(fz_Allocator a): allocator(a) {}
+
+    fz_Allocator resolve() const {
+        return allocator.oper_func ? allocator : fz_global_allocator;
+    }
+
+    // parenthesized: the fz_ALLOC_STATS macros would put this line down as the site.
+    void *allocate(size_t size, size_t alignment) {
+        fz__container_site();
+        return (fz_alloc_aligned)(resolve(), size, alignment);
+    }
+    void *reallocate(void *ptr, size_t old_size, size_t size, size_t alignment) {
+        fz__container_site();
+        return (fz_realloc_aligned)(resolve(), ptr, old_size, size, alignment);
+    }
+    void deallocate(void *ptr) {
+        fz_free_ex(resolve(), ptr);
+    }
+
+private:
+    static void fz__container_site() {
+#if defined(fz_ALLOC_STATS)
+        fz__alloc_site = fz_CONTAINER_SITE;
+#endif
+    }
+};
+
+struct fz_Heap_Policy {
+    void *allocate(size_t size, size_t alignment) {
+        return fz_platform_alloc_aligned(size, alignment);
+    }
+    void *reallocate(void *ptr, size_t old_size, size_t size, size_t alignment) {
+        return fz_platform_realloc_aligned(ptr, old_size, size, alignment);
+    }
+    void deallocate(void *ptr) {
+        fz_platform_free(ptr);
+    }
+};
+
+// only committing more memory leaves the inline path.
+struct fz_Arena_Policy {
+    fz_Arena *arena;
+
+    fz_Arena_Policy(fz_Arena *a = NULL): arena(a) {}
+
+    void *allocate(size_t size, size_t alignment) {
+        if (size < fz_PUSH_ALIGNMENT) size = fz_PUSH_ALIGNMENT;
+
+        uintptr_t top = (uintptr_t)(arena->memory + arena->used);
+        uintptr_t at  = (top + (alignment - 1)) & ~(uintptr_t)(alignment - 1);
+        size_t    end = (size_t)(at - (uintptr_t)arena->memory) + size;
+        if (end > arena->committed) {
+            return fz_arena_operation(fz_MEMORY_OPER_ALLOCATE, NULL, 0, size, alignment, arena);
+        }
+
+        arena->used = end;
+        if (end > arena->high_water) arena->high_water = end;
+        return (void *)at;
+    }
+
+    void *reallocate(void *ptr, size_t old_size, size_t size, size_t alignment) {
+        uint8_t *at = (uint8_t *)ptr;
+        if (at + old_size == arena->memory + arena->used && ((uintptr_t)at & (alignment - 1)) == 0) {
+            if (size <= old_size) return ptr;
+
+            size_t end = (size_t)(at - arena->memory) + size;
+            if (end <= arena->committed) {
+                arena->used = end;
+                if (end > arena->high_water) arena->high_water = end;
+                return ptr;
+            }
+        }
+        return fz_arena_operation(fz_MEMORY_OPER_REALLOCATE, ptr, old_size, size, alignment, arena);
+    }
+
+    void deallocate(void *ptr) {
+        fz_UNUSED(ptr);
+    }
+};
+
+// same layout as fz_stack_operation, so the two can be mixed on one stack.
+struct fz_Stack_Policy {
+    fz_StackAlloc *stack;
+
+    fz_Stack_Policy(fz_StackAlloc *s = NULL): stack(s) {}
+
+    void *allocate(size_t size, size_t alignment) {
+        if (alignment < fz_PUSH_ALIGNMENT) alignment = fz_PUSH_ALIGNMENT;
+
+        uintptr_t top  = (uintptr_t)(stack->base + stack->current);
+        uintptr_t user = fz_align_to_power_of_two(top + sizeof(fz_Stack_Header), alignment);
+        size_t    end  = (size_t)(user - (uintptr_t)stack->base) + size;
+        assert(end <= stack->caps);
+
+        fz_Stack_Header *header = (fz_Stack_Header *)user - 1;
+        header->prev_offset = stack->prev;
+        header->padding     = (uintptr_t)header - top;
+
+        stack->prev    = stack->current;
+        stack->current = end;
+        return (void *)user;
+    }
+
+    void *reallocate(void *ptr, size_t old_size, size_t size, size_t alignment) {
+        fz_UNUSED(old_size);
+        fz_Stack_Header *header = (fz_Stack_Header *)ptr - 1;
+        assert(stack->prev == (size_t)((uint8_t *)header - header->padding - stack->base) && "stack realloc must be on the top allocation.");
+        assert(((uintptr_t)ptr & (alignment - 1)) == 0 && "stack can't move an allocation to a bigger alignment.");
+        fz_UNUSED(header);
+        fz_UNUSED(alignment);
+
+        size_t end = (size_t)((uint8_t *)ptr - stack->base) + size;
+        assert(end <= stack->caps);
+        stack->current = end;
+        return ptr;
+    }
+
+    void deallocate(void *ptr) {
+        fz_Stack_Header *header = (fz_Stack_Header *)ptr - 1;
+        assert(stack->prev == (size_t)((uint8_t *)header - header->padding - stack->base) && "Order difference: stack free must follow LIFO rules.");
+
+        stack->current = stack->prev;
+        stack->prev    = header->prev_offset;
+    }
+};
+
+// same free list and bump as fz_pool_operation, so the two can be mixed on one pool.
+struct fz_Pool_Policy {
+    fz_Pool *pool;
+
+    fz_Pool_Policy(fz_Pool *p = NULL): pool(p) {}
+
+    void *allocate(size_t size, size_t alignment) {
+        assert(size == pool->element_size && alignment <= pool->alignment);
+        fz_UNUSED(alignment);
+        void *result;
+
+        if (pool->free) {
+            result = pool->free;
+            pool->free = pool->free->next;
+        } else if (pool->bumped < pool->capacity) {
+            result = pool->base + pool->bumped * pool->stride;
+            pool->bumped += 1;
+        } else {
+            return NULL;
+        }
+
+        if (pool->zero_memory) memset(result, 0, size);
+        return result;
+    }
+
+    void *reallocate(void *ptr, size_t old_size, size_t size, size_t alignment) {
+        fz_UNUSED(ptr); fz_UNUSED(old_size); fz_UNUSED(size); fz_UNUSED(alignment);
+        fz_UNREACHABLE_PATH;
+        return NULL;
+    }
+
+    void deallocate(void *ptr) {
+        assert(pool->base <= ptr && ptr < (pool->base + pool->bumped * pool->stride));
+        fz_SLL_Header *freed = (fz_SLL_Header *)ptr;
+        freed->next = pool->free;
+        pool->free  = freed;
+    }
+};
+
+// type erasure: any policy behind the usual fz_Allocator. the policy must outlive it.
+template<typename Policy>
+fz_OPER_FUNC(fz_policy_operation) {
+    Policy *policy = (Policy *)user_data;
+
+    switch(op) {
+        case fz_MEMORY_OPER_ALLOCATE:
+            return policy->allocate(size, alignment);
+
+        case fz_MEMORY_OPER_FREE:
+            policy->deallocate(ptr); return NULL;
+
+        case fz_MEMORY_OPER_REALLOCATE:
+            return policy->reallocate(ptr, old_size, size, alignment);
+    }
+    return NULL;
+}
+
+template<typename Policy>
+fz_Allocator fz_policy_allocator(Policy *policy) {
+    fz_Allocator result;
+    result.user_data = (void *)policy;
+    result.oper_func = fz_policy_operation<Policy>;
+    return result;
+}
+
+/*
+ * ==================================================
+ * Typed Array.
+ * same growth idea as fz_Vec, but the element type is known to the compiler,
+ * non-trivial types are moved instead of memcpy'd, and the first InlineCount
+ * elements can live inside the array itself without touching the allocator.
+ * Policy is one of the allocator policies above; the default takes any fz_Allocator.
+ *
+ * usage:
+ *     fz_Array<Entity, 16> list(fz_arena_allocator(&arena));
+ *     list.reserve(256);
+ *     list.push(e);
+ *     for (Entity &e : list) { ... }
+ * ==================================================
+ * */
+
+template<typename T, size_t InlineCount = 0, typename Policy = fz_Dynamic_Policy>
+struct fz_Array {
+    T      *data;
+    size_t  used;
+    size_t  caps;
+    Policy  allocator;
+
+    alignas(T) uint8_t inline_storage[InlineCount > 0 ? InlineCount * sizeof(T) : 1];
+
+    static const bool trivial = std::is_trivially_copyable<T>::value;
+
+    fz_Array()                 { setup(Policy()); }
+    explicit fz_Array(Policy a) { setup(a); }
+
+    fz_Array(const fz_Array &)            = delete;
+    fz_Array &operator=(const fz_Array &) = delete;
+
+    fz_Array(fz_Array &&other) {
+        setup(other.allocator);
+        take(other);
+    }
+
+    fz_Array &operator=(fz_Array &&other) {
+        if (this != &other) {
+            release();
+            allocator = other.allocator;
+            take(other);
+        }
+        return *this;
+    }
+
+    ~fz_Array() { release(); }
+
+    // ==========================
+    // access.
+
+    size_t count()    const { return used; }
+    size_t capacity() const { return caps; }
+    bool   empty()    const { return used == 0; }
+
+    T       &operator[](size_t i)       { assert(i < used); return data[i]; }
+    const T &operator[](size_t i) const { assert(i < used); return data[i]; }
+
+    T       *begin()       { return data; }
+    T       *end()         { return data + used; }
+    const T *begin() const { return data; }
+    const T *end()   const { return data + used; }
+
+    T &last() { assert(used > 0); return data[used - 1]; }
+
+    // ==========================
+    // capacity.
+
+    // makes sure `n` elements fit without another allocation.
+    void reserve(size_t n) {
+        if (n > caps) regrow(n);
+    }
+
+    void resize(size_t n) {
+        reserve(n);
+        for (size_t i = used; i < n; ++i) new (&data[i]) T();
+        destroy_range(n, used);
+        used = n;
+    }
+
+    // keeps the memory around: clearing every frame will not hit the allocator again.
+    void clear() {
+        destroy_range(0, used);
+        used = 0;
+    }
+
+    void release() {
+        clear();
+        if (!is_inline() && data) {
+            allocator.deallocate(data);
+        }
+        data = empty_data();
+        caps = InlineCount;
+    }
+
+    // ==========================
+    // insertion / removal.
+
+    // the argument may be one of our own elements, which growing frees:
+    // it's taken out first whenever growing is about to happen.
+    T &push(const T &item) {
+        if (used == caps) {
+            T copy(item);
+            maybe_grow(1);
+            return *new (&data[used++]) T(std::move(copy));
+        }
+        return *new (&data[used++]) T(item);
+    }
+
+    T &push(T &&item) {
+        if (used == caps) {
+            T taken(std::move(item));
+            maybe_grow(1);
+            return *new (&data[used++]) T(std::move(taken));
+        }
+        return *new (&data[used++]) T(std::move(item));
+    }
+
+    template<typename ...Args>
+    T &emplace(Args &&...args) {
+        if (used == caps) {
+            T made(std::forward<Args>(args)...);
+            maybe_grow(1);
+            return *new (&data[used++]) T(std::move(made));
+        }
+        return *new (&data[used++]) T(std::forward<Args>(args)...);
+    }
+
+    // appends `n` copies of items[0..n).
+    T *push_n(const T *items, size_t n) {
+        if (overlaps(items, n)) {
+            fz_Array staged(allocator);
+            staged.push_n(items, n);
+            return push_n(staged.data, n);
+        }
+
+        maybe_grow(n);
+        T *dest = data + used;
+        if (trivial) {
+            if (n) memcpy((void *)dest, (const void *)items, sizeof(T) * n);
+        } else {
+            for (size_t i = 0; i < n; ++i) new (&dest[i]) T(items[i]);
+        }
+        used += n;
+        return dest;
+    }
+
+    T pop() {
+        assert(used > 0);
+        T result = std::move(data[used - 1]);
+        destroy_range(used - 1, used);
+        used -= 1;
+        return result;
+    }
+
+    // inserts items[0..n) before `index`, keeping the order.
+    T *insert(size_t index, const T *items, size_t n) {
+        assert(index <= used);
+        if (overlaps(items, n)) {
+            // shifting the tail (or growing) would move them out from under us.
+            fz_Array staged(allocator);
+            staged.push_n(items, n);
+            return insert(index, staged.data, n);
+        }
+
+        maybe_grow(n);
+
+        T *at = data + index;
+        size_t tail = used - index;
+        if (trivial) {
+            if (tail) memmove((void *)(at + n), (const void *)at, sizeof(T) * tail);
+            if (n)    memcpy((void *)at, (const void *)items, sizeof(T) * n);
+        } else {
+            for (size_t i = tail; i > 0; --i) {
+                size_t from = index + i - 1;
+                new (&data[from + n]) T(std::move(data[from]));
+                data[from].~T();
+            }
+            for (size_t i = 0; i < n; ++i) new (&at[i]) T(items[i]);
+        }
+        used += n;
+        return at;
+    }
+
+    T *insert(size_t index, const T &item) { return insert(index, &item, 1); }
+
+    // removes [index, index + n), keeping the order.
+    void erase(size_t index, size_t n = 1) {
+        assert(index + n <= used);
+        T *at = data + index;
+        size_t tail = used - (index + n);
+
+        if (trivial) {
+            if (tail) memmove((void *)at, (const void *)(at + n), sizeof(T) * tail);
+        } else {
+            for (size_t i = 0; i < tail; ++i) at[i] = std::move(at[i + n]);
+            destroy_range(used - n, used);
+        }
+        used -= n;
+    }
+
+    // O(1) removal; the last element takes the removed slot.
+    void erase_unordered(size_t index) {
+        assert(index < used);
+        if (index != used - 1) data[index] = std::move(data[used - 1]);
+        destroy_range(used - 1, used);
+        used -= 1;
+    }
+
+private:
+    T   *inline_data()     { return (T *)(void *)inline_storage; }
+    T   *empty_data()      { return InlineCount > 0 ? inline_data() : NULL; }
+    bool is_inline() const { return InlineCount > 0 && (const void *)data == (const void *)inline_storage; }
+
+    bool overlaps(const T *items, size_t n) const {
+        uintptr_t begin = (uintptr_t)data, end = (uintptr_t)(data + caps);
+        return n > 0 && (uintptr_t)items < end && begin < (uintptr_t)(items + n);
+    }
+
+    void setup(Policy a) {
+        allocator = a;
+        data      = empty_data();
+        used      = 0;
+        caps      = InlineCount;
+    }
+
+    void take(fz_Array &other) {
+        if (other.is_inline()) {
+            // inline storage can not be stolen; elements are moved one by one.
+            for (size_t i = 0; i < other.used; ++i) new (&data[i]) T(std::move(other.data[i]));
+            used = other.used;
+            other.clear();
+        } else {
+            data = other.data;
+            used = other.used;
+            caps = other.caps;
+            other.data = other.empty_data();
+            other.used = 0;
+            other.caps = InlineCount;
+        }
+    }
+
+    void destroy_range(size_t from, size_t to) {
+        if (!std::is_trivially_destructible<T>::value) {
+            for (size_t i = from; i < to; ++i) data[i].~T();
+        }
+    }
+
+    void maybe_grow(size_t n) {
+        if (used + n > caps) {
+            size_t next = caps ? caps * 2 : 8;
+            while (next < used + n) next *= 2;
+            regrow(next);
+        }
+    }
+
+    void regrow(size_t next_caps) {
+        assert(next_caps > caps);
+        const size_t alignment = alignof(T) > fz_PUSH_ALIGNMENT ? alignof(T) : fz_PUSH_ALIGNMENT;
+        T *next;
+
+        if (trivial && !is_inline() && data) {
+            // fast path: the allocator may extend in place (heap realloc, top-of-arena).
+            next = (T *)allocator.reallocate(data, sizeof(T) * caps, sizeof(T) * next_caps, alignment);
+        } else {
+            next = (T *)allocator.allocate(sizeof(T) * next_caps, alignment);
+            if (trivial) {
+                if (used) memcpy((void *)next, (const void *)data, sizeof(T) * used);
+            } else {
+                for (size_t i = 0; i < used; ++i) {
+                    new (&next[i]) T(std::move(data[i]));
+                    data[i].~T();
+                }
+            }
+            if (!is_inline() && data) allocator.deallocate(data);
+        }
+
+        assert(next && "fz_Array: allocator returned NULL.");
+        data = next;
+        caps = next_caps;
+    }
+};
+#endif
+
+/*
+ * ==================================================
+ * Sorting.
+ * everything is a template so the comparator gets inlined,
+ * instead of going through a function pointer like qsort does.
+ *
+ *  fz_sort          -- introsort. `less(a, b)` returns true when a goes before b.
+ *  fz_sort_small    -- sorting network, for n <= 8. used by fz_sort for the leaves.
+ *  fz_radix_sort    -- LSD radix sort on a 32bit key. stable, needs a scratch buffer of n elements.
+ *
+ * usage:
+ *     fz_sort(scores, count, [](int a, int b) { return a > b; });
+ *     fz_radix_sort(entities, scratch, count, [](const Entity &e) { return fz_radix_key_f32(e.depth); });
+ * ==================================================
+ * */
+
+template<typename T>
+inline void fz__sort_swap(T &a, T &b) {
+    T tmp = std::move(a);
+    a = std::move(b);
+    b = std::move(tmp);
+}
+
+template<typename T, typename Less>
+inline void fz__sort_cas(T *items, int i, int j, Less &less) {
+    if (less(items[j], items[i])) fz__sort_swap(items[i], items[j]);
+}
+
+// Optimal (or best known) compare-and-swap networks for 2..8 elements.
+template<typename T, typename Less>
+void fz_sort_small(T *items, size_t n, Less less) {
+    static const uint8_t net2[] = { 0,1 };
+    static const uint8_t net3[] = { 0,2, 0,1, 1,2 };
+    static const uint8_t net4[] = { 0,1, 2,3, 0,2, 1,3, 1,2 };
+    static const uint8_t net5[] = { 0,1, 3,4, 2,4, 2,3, 0,3, 0,2, 1,4, 1,3, 1,2 };
+    static const uint8_t net6[] = { 1,2, 4,5, 0,2, 3,5, 0,1, 3,4, 1,4, 0,3, 2,5, 1,3, 2,4, 2,3 };
+    static const uint8_t net7[] = { 1,2, 3,4, 5,6, 0,2, 3,5, 4,6, 0,1, 4,5, 2,6, 0,4, 1,5, 0,3,
+                                    2,5, 1,3, 2,4, 2,3 };
+    static const uint8_t net8[] = { 0,1, 2,3, 4,5, 6,7, 0,2, 1,3, 4,6, 5,7, 1,2, 5,6, 0,4, 3,7,
+                                    1,5, 2,6, 1,4, 3,6, 2,4, 3,5, 3,4 };
+
+    static const uint8_t *nets[]  = { 0, 0, net2, net3, net4, net5, net6, net7, net8 };
+    static const size_t   sizes[] = { 0, 0, sizeof(net2), sizeof(net3), sizeof(net4), sizeof(net5),
+                                      sizeof(net6), sizeof(net7), sizeof(net8) };
+    assert(n <= 8 && "fz_sort_small only handles up to 8 elements.");
+
+    const uint8_t *net = nets[n];
+    for (size_t i = 0; i < sizes[n]; i += 2) {
+        fz__sort_cas(items, net[i], net[i + 1], less);
+    }
+}
+
+template<typename T, typename Less>
+void fz__sort_insertion(T *items, size_t n, Less &less) {
+    for (size_t i = 1; i < n; ++i) {
+        T key = std::move(items[i]);
+        size_t j = i;
+        while (j > 0 && less(key, items[j - 1])) {
+            items[j] = std::move(items[j - 1]);
+            --j;
+        }
+        items[j] = std::move(key);
+    }
+}
+
+template<typename T, typename Less>
+void fz__sort_sift_down(T *items, size_t root, size_t n, Less &less) {
+    for (;;) {
+        size_t child = root * 2 + 1;
+        if (child >= n) break;
+        if (child + 1 < n && less(items[child], items[child + 1])) child += 1;
+        if (!less(items[root], items[child])) break;
+
+        fz__sort_swap(items[root], items[child]);
+        root = child;
+    }
+}
+
+template<typename T, typename Less>
+void fz__sort_heap(T *items, size_t n, Less &less) {
+    for (size_t i = n / 2; i > 0; --i) fz__sort_sift_down(items, i - 1, n, less);
+    for (size_t i = n; i > 1; --i) {
+        fz__sort_swap(items[0], items[i - 1]);
+        fz__sort_sift_down(items, 0, i - 1, less);
+    }
+}
+
+template<typename T, typename Less>
+void fz__sort_intro(T *items, size_t n, int depth, Less &less) {
+    while (n > 16) {
+        if (depth-- == 0) {
+            // quicksort is going quadratic. bail out to heapsort.
+            fz__sort_heap(items, n, less);
+            return;
+        }
+
+        // median of three goes into items[0] and becomes the pivot.
+        size_t mid = n / 2;
+        fz__sort_cas(items, 0, (int)mid, less);
+        fz__sort_cas(items, (int)mid, (int)(n - 1), less);
+        fz__sort_cas(items, 0, (int)mid, less);
+        fz__sort_swap(items[0], items[mid]);
+
+        size_t lo = 1, hi = n - 1;
+        for (;;) {
+            while (less(items[lo], items[0])) ++lo;
+            while (less(items[0], items[hi])) --hi;
+            if (lo >= hi) break;
+
+            fz__sort_swap(items[lo], items[hi]);
+            ++lo; --hi;
+        }
+        fz__sort_swap(items[0], items[hi]);
+
+        // recurse into the smaller half, loop on the bigger one.
+        size_t left = hi, right = n - hi - 1;
+        if (left < right) {
+            fz__sort_intro(items, left, depth, less);
+            items += hi + 1;
+            n = right;
+        } else {
+            fz__sort_intro(items + hi + 1, right, depth, less);
+            n = left;
+        }
+    }
+
+    if (n <= 8) fz_sort_small(items, n, less);
+    else        fz__sort_insertion(items, n, less);
+}
+
+template<typename T, typename Less>
+void fz_sort(T *items, size_t n, Less less) {
+    if (n < 2) return;
+
+    int depth = 0;
+    for (size_t i = n; i > 1; i >>= 1) depth += 2;
+    fz__sort_intro(items, n, depth, less);
+}
+
+template<typename T>
+void fz_sort(T *items, size_t n) {
+    fz_sort(items, n, [](const T &a, const T &b) { return a < b; });
+}
+
+// ==========================
+// Radix sort.
+
+// maps keys onto uint32 so that unsigned order matches the original order.
+inline uint32_t fz_radix_key_u32(uint32_t k) { return k; }
+inline uint32_t fz_radix_key_i32(int32_t k)  { return (uint32_t)k ^ 0x80000000u; }
+inline uint32_t fz_radix_key_f32(float k) {
+    uint32_t bits;
+    memcpy(&bits, &k, sizeof(bits));
+    // negative: flip everything, positive: flip the sign bit.
+    uint32_t mask = (uint32_t)(-(int32_t)(bits >> 31)) | 0x80000000u;
+    return bits ^ mask;
+}
+
+//! @param items   elements to sort. sorted result ends up here.
+//! @param scratch buffer of at least n elements, contents are garbage afterwards.
+//! @param key     `uint32_t key(const T &)`, use fz_radix_key_* to map signed / float keys.
+//! @param descending reverses the order; equal keys still keep their relative order.
+template<typename T, typename Key>
+void fz_radix_sort(T *items, T *scratch, size_t n, Key key, bool descending = false) {
+    if (n < 2) return;
+
+    size_t counts[4][256];
+    memset(counts, 0, sizeof(counts));
+
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t k = key(items[i]);
+        if (descending) k = ~k;
+        counts[0][(k >>  0) & 0xFF] += 1;
+        counts[1][(k >>  8) & 0xFF] += 1;
+        counts[2][(k >> 16) & 0xFF] += 1;
+        counts[3][(k >> 24) & 0xFF] += 1;
+    }
+
+    T *from = items;
+    T *to   = scratch;
+    for (int pass = 0; pass < 4; ++pass) {
+        int shift = pass * 8;
+        size_t *count = counts[pass];
+
+        // every key has the same digit: this pass would be a plain copy.
+        if (count[(key(from[0]) ^ (descending ? 0xFFFFFFFFu : 0)) >> shift & 0xFF] == n) continue;
+
+        size_t offset = 0;
+        for (int b = 0; b < 256; ++b) {
+            size_t c = count[b];
+            count[b] = offset;
+            offset  += c;
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t k = key(from[i]);
+            if (descending) k = ~k;
+            to[count[(k >> shift) & 0xFF]++] = std::move(from[i]);
+        }
+
+        T *tmp = from; from = to; to = tmp;
+    }
+
+    if (from != items) {
+        for (size_t i = 0; i < n; ++i) items[i] = std::move(from[i]);
+    }
+}
+
+#if !defined(fz_MINIMAL_FOOTPRINT)
+// fz_Vec_Sort stays on qsort: all it knows is the element size and a C comparator
+// behind a pointer, which fz_sort couldn't inline either. this one has the type.
+#define fz_Vec_SortBy(array, less) ((array) ? fz_sort((array), (size_t)fz_Vec_Length(array), (less)) : (void)0)
+#endif
+
+/*
+ * ==================================================
+ * SPSC Queue.
+ * bounded, lock-free, single producer / single consumer.
+ * push never blocks: it returns false when the queue is full.
+ *
+ * usage:
+ *     static fz_SPSC_Queue<Record, 4096> queue;
+ *     // producer thread          // consumer thread
+ *     queue.push(r);              while (queue.pop(&r)) { ... }
+ * ==================================================
+ * */
+
+#include <atomic>
+
+template<typename T, size_t Capacity>
+struct fz_SPSC_Queue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "fz_SPSC_Queue: Capacity has to be a power of two.");
+
+    // on separate cache lines, so the two threads don't fight over one.
+    alignas(64) std::atomic<size_t> head; // next slot to read.  written by the consumer.
+    alignas(64) std::atomic<size_t> tail; // next slot to write. written by the producer.
+    alignas(64) T items[Capacity];
+
+    fz_SPSC_Queue(): head(0), tail(0) {}
+
+    bool push(const T &item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+
+        items[t & (Capacity - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T *out) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+
+        *out = items[h & (Capacity - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only: the next item without taking it, NULL when empty.
+    T *peek() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return NULL;
+        return &items[h & (Capacity - 1)];
+    }
+
+    // exact from either end's own thread, a snapshot otherwise.
+    size_t count() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+};
+
+/*
+ * ==================================================
+ * Triple Buffer.
+ * one writer, one reader; the reader always sees the latest complete value,
+ * and neither side ever waits. the writer fills its own slot and swaps it
+ * into the middle, the reader swaps the middle out when it's fresh.
+ *
+ * usage:
+ *     static fz_Triple_Buffer<State> states;
+ *     // writer thread                // reader thread
+ *     fill(states.write_slot());      states.acquire();
+ *     states.publish();               draw(states.read_slot());
+ * ==================================================
+ * */
+
+template<typename T>
+struct fz_Triple_Buffer {
+    enum { FRESH = 4 }; // set in middle when the writer published something the reader hasn't taken.
+
+    T slots[3];
+    alignas(64) std::atomic<unsigned> middle;
+    alignas(64) unsigned back;  // writer only.
+    alignas(64) unsigned front; // reader only.
+
+    fz_Triple_Buffer(): middle(1), back(0), front(2) {}
+
+    T *write_slot() { return &slots[back]; }
+
+    void publish() {
+        unsigned old = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = old & ~FRESH;
+    }
+
+    // reader only: whether acquire() would pick something up.
+    bool fresh() const {
+        return (middle.load(std::memory_order_acquire) & FRESH) != 0;
+    }
+
+    //! @return true when a newer value was picked up. read_slot() is the latest either way.
+    bool acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+
+        unsigned old = middle.exchange(front, std::memory_order_acq_rel);
+        front = old & ~FRESH;
+        return true;
+    }
+
+    const T *read_slot() const { return &slots[front]; }
+};
+
+/*
+ * ==================================================
+ * Timing Wheel.
+ * hierarchical: fz_WHEEL_LEVELS levels of 64 slots, a slot on level n spans
+ * 64^n ticks. a timer sits in one slot and only moves when its level cascades
+ * into the one below, so a timer that isn't due costs nothing per tick.
+ *
+ * the unit of a tick is up to the owner. everything is index based and
+ * pointer free, so a wheel can be memcpy'd, snapshotted or saved along with
+ * whatever it lives in. handles carry a generation: a stale handle can't
+ * cancel somebody else's timer.
+ *
+ * usage:
+ *     static fz_Timing_Wheel<1024> wheel; // zeroed == empty, or call init().
+ *     fz_Timer_Handle h = wheel.schedule(500, KIND, user);
+ *     wheel.cancel(h);
+ *     wheel.advance(16, [](fz_Timer_Handle h, int kind, uint32_t user) { ... });
+ * ==================================================
+ * */
+
+#define fz_WHEEL_LEVELS 4
+#define fz_WHEEL_BITS   6
+#define fz_WHEEL_SLOTS  (1 << fz_WHEEL_BITS)
+#define fz_WHEEL_NIL    0xFFFF
+
+// 0 is never a valid handle. low 16 bits: node + 1, high 16 bits: generation.
+typedef uint32_t fz_Timer_Handle;
+
+template<uint32_t Capacity>
+struct fz_Timing_Wheel {
+    static_assert(Capacity < fz_WHEEL_NIL, "fz_Timing_Wheel: Capacity has to fit in 16 bits.");
+
+    struct Node {
+        uint64_t due;
+        uint32_t user;
+        int32_t  kind;
+        uint16_t next;
+        uint16_t prev;
+        uint16_t slot;       // index into heads, fz_WHEEL_NIL when free.
+        uint16_t generation;
+    };
+
+    uint64_t now;
+    uint32_t active;
+    uint16_t free_head;  // first released node + 1, 0 when there is none.
+    uint16_t fresh;      // nodes below this have been used at least once.
+    uint16_t heads[fz_WHEEL_LEVELS * fz_WHEEL_SLOTS]; // stores node + 1; 0 is empty.
+    Node     nodes[Capacity];
+
+    // zero-initialized memory is an empty wheel too; this is only for reuse.
+    void init() {
+        now       = 0;
+        active    = 0;
+        free_head = 0;
+        fresh     = 0;
+        memset(heads, 0, sizeof(heads));
+        for (uint32_t i = 0; i < Capacity; ++i) nodes[i].slot = fz_WHEEL_NIL;
+    }
+
+    //! delay 0 is treated as 1: a timer never fires in the tick it was made in.
+    //! @return 0 when the wheel is full.
+    fz_Timer_Handle schedule(uint64_t delay, int kind, uint32_t user) {
+        uint16_t index;
+        if (free_head) {
+            index     = free_head - 1;
+            free_head = nodes[index].next;
+        } else if (fresh < Capacity) {
+            index = fresh++;
+        } else {
+            return 0;
+        }
+
+        Node *n = &nodes[index];
+        n->due  = now + (delay ? delay : 1);
+        n->kind = kind;
+        n->user = user;
+        place(index);
+        active += 1;
+        return handle_of(index);
+    }
+
+    //! @return true when the timer was still pending.
+    bool cancel(fz_Timer_Handle handle) {
+        Node *n = lookup(handle);
+        if (!n) return false;
+
+        release((uint16_t)(n - nodes));
+        return true;
+    }
+
+    bool pending(fz_Timer_Handle handle) const {
+        return lookup(handle) != NULL;
+    }
+
+    //! @return ticks until it fires, 0 when it isn't pending.
+    uint64_t remaining(fz_Timer_Handle handle) const {
+        const Node *n = lookup(handle);
+        return n ? n->due - now : 0;
+    }
+
+    //! for a wheel that came from outside (a file, the network): every node below
+    //! fresh is on exactly one list, the free chain or the slot it says it's in,
+    //! the slot lists link both ways, and nothing pending is already due.
+    //! schedule, cancel and advance trust all of that without checking.
+    bool valid() const {
+        if (fresh > Capacity) return false;
+
+        uint8_t seen[Capacity] = {};
+        uint32_t listed = 0;
+
+        for (uint16_t it = free_head; it; it = nodes[it - 1].next) {
+            uint16_t index = it - 1;
+            if (index >= fresh || seen[index])      return false;
+            if (nodes[index].slot != fz_WHEEL_NIL)  return false;
+            seen[index] = 1;
+            listed += 1;
+        }
+
+        uint32_t live = 0;
+        for (uint16_t slot = 0; slot < fz_WHEEL_LEVELS * fz_WHEEL_SLOTS; ++slot) {
+            uint16_t prev = 0;
+            for (uint16_t it = heads[slot]; it; prev = it, it = nodes[it - 1].next) {
+                uint16_t index = it - 1;
+                if (index >= fresh || seen[index]) return false;
+
+                const Node *n = &nodes[index];
+                if (n->slot != slot || n->prev != prev || n->due <= now) return false;
+                seen[index] = 1;
+                live += 1;
+            }
+        }
+
+        return live == active && listed + live == fresh;
+    }
+
+    // fire(fz_Timer_Handle, int kind, uint32_t user) runs once per expired timer,
+    // in due order. it may schedule and cancel freely.
+    template<typename Fire>
+    void advance(uint64_t ticks, Fire &&fire) {
+        if (active == 0) {
+            now += ticks;
+            return;
+        }
+
+        for (uint64_t t = 0; t < ticks; ++t) {
+            now += 1;
+
+            // on a level boundary, the next level's current slot comes down first.
+            for (int level = 1; level < fz_WHEEL_LEVELS; ++level) {
+                uint64_t mask = ((uint64_t)1 << (level * fz_WHEEL_BITS)) - 1;
+                if (now & mask) break;
+                cascade(level);
+            }
+
+            uint16_t *head = &heads[now & (fz_WHEEL_SLOTS - 1)];
+            while (*head) {
+                uint16_t index = *head - 1;
+                Node *n = &nodes[index];
+                fz_Timer_Handle handle = handle_of(index);
+                int kind = n->kind;
+                uint32_t user = n->user;
+
+                release(index);
+                fire(handle, kind, user);
+            }
+
+            if (active == 0) {
+                now += ticks - t - 1;
+                return;
+            }
+        }
+    }
+
+    // internals.
+    fz_Timer_Handle handle_of(uint16_t index) const {
+        return ((fz_Timer_Handle)nodes[index].generation << 16) | (fz_Timer_Handle)(index + 1);
+    }
+
+    const Node *lookup(fz_Timer_Handle handle) const {
+        uint32_t index = (handle & 0xFFFF);
+        if (index == 0 || index > fresh) return NULL;
+
+        const Node *n = &nodes[index - 1];
+        if (n->slot == fz_WHEEL_NIL || n->generation != (handle >> 16)) return NULL;
+        return n;
+    }
+
+    Node *lookup(fz_Timer_Handle handle) {
+        return (Node *)((const fz_Timing_Wheel *)this)->lookup(handle);
+    }
+
+    void place(uint16_t index) {
+        Node *n = &nodes[index];
+        uint64_t delta = n->due - now;
+
+        int level = 0;
+        while (level < fz_WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << ((level + 1) * fz_WHEEL_BITS))) level += 1;
+
+        uint64_t when = n->due;
+        if (delta >= ((uint64_t)1 << (fz_WHEEL_LEVELS * fz_WHEEL_BITS))) {
+            // past the top: park it in the last top-level slot, it gets re-placed on the way down.
+            when = now + ((uint64_t)(fz_WHEEL_SLOTS - 1) << (level * fz_WHEEL_BITS));
+        }
+
+        uint16_t slot = level * fz_WHEEL_SLOTS + ((when >> (level * fz_WHEEL_BITS)) & (fz_WHEEL_SLOTS - 1));
+        n->slot = slot;
+        n->prev = 0;
+        n->next = heads[slot];
+        if (heads[slot]) nodes[heads[slot] - 1].prev = index + 1;
+        heads[slot] = index + 1;
+    }
+
+    void unlink(uint16_t index) {
+        Node *n = &nodes[index];
+        if (n->prev) nodes[n->prev - 1].next = n->next;
+        else         heads[n->slot] = n->next;
+        if (n->next) nodes[n->next - 1].prev = n->prev;
+    }
+
+    void release(uint16_t index) {
+        Node *n = &nodes[index];
+        unlink(index);
+        n->slot        = fz_WHEEL_NIL;
+        n->generation += 1;
+        n->next        = free_head;
+        free_head      = index + 1;
+        active        -= 1;
+    }
+
+    void cascade(int level) {
+        uint16_t slot = level * fz_WHEEL_SLOTS + ((now >> (level * fz_WHEEL_BITS)) & (fz_WHEEL_SLOTS - 1));
+        uint16_t it = heads[slot];
+        heads[slot] = 0;
+
+        while (it) {
+            uint16_t index = it - 1;
+            it = nodes[index].next;
+            place(index);
+        }
+    }
+};
+
 #endif
 
 
@@ -524,6 +2058,12 @@ fz_Allocator fz_set_allocator(fz_Allocator new_allocator) {
     return old;
 }
 
+// installs new_allocator as the global one and returns the one it replaced,
+// so a hook (e.g. fz_tracked_allocator) can forward to it.
+fz_Allocator fz_hook_at_alloc(fz_Allocator new_allocator) {
+    return fz_set_allocator(new_allocator);
+}
+
 fz_Allocator fz_set_temp_allocator(fz_Allocator new_allocator) {
     fz_Allocator old = fz_global_temp_allocator;
     fz_global_temp_allocator = new_allocator;
@@ -537,41 +2077,214 @@ fz_Allocator fz_set_temp_allocator(fz_Allocator new_allocator) {
  * ==================================================
  * */
 
-// ===============================================
-// you can rewrite these functions to implement
-// your very own platform allocation functions!!
+// ===============================================
+// you can rewrite these functions to implement
+// your very own platform allocation functions!!
+
+// malloc already aligns this much; anything asking for more takes the slower aligned route.
+#define fz__MALLOC_ALIGNMENT (2 * sizeof(void *))
+
+// msvc's aligned blocks can't go through free(), so on windows every block is an aligned one.
+#if defined(fz_OS_WINDOWS)
+#include <malloc.h>
+#endif
+
+void *fz_platform_alloc(size_t size) {
+    assert(size > 0);
+#if defined(fz_OS_WINDOWS)
+    void *result = _aligned_malloc(size, fz__MALLOC_ALIGNMENT);
+#else
+    void *result = malloc(size);
+#endif
+
+    assert(result && "Failed to allocate memory.");
+    return result;
+}
+
+void *fz_platform_realloc(void *ptr, size_t size) {
+    assert(size > 0);
+#if defined(fz_OS_WINDOWS)
+    void *result = _aligned_realloc(ptr, size, fz__MALLOC_ALIGNMENT);
+#else
+    void *result = realloc(ptr, size);
+#endif
+
+    assert(result && "Failed to reallocate memory.");
+    return result;
+}
+
+void fz_platform_free(void *ptr) {
+    assert(ptr && "trying to free a pointer that is null.");
+#if defined(fz_OS_WINDOWS)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+void *fz_platform_alloc_aligned(size_t size, size_t alignment) {
+    assert(size > 0 && (alignment & (alignment - 1)) == 0);
+    if (alignment <= fz__MALLOC_ALIGNMENT) return fz_platform_alloc(size);
+
+#if defined(fz_OS_WINDOWS)
+    void *result = _aligned_malloc(size, alignment);
+#else
+    void *result = NULL;
+    if (posix_memalign(&result, alignment, size) != 0) result = NULL;
+#endif
+
+    assert(result && "Failed to allocate aligned memory.");
+    return result;
+}
+
+void *fz_platform_realloc_aligned(void *ptr, size_t old_size, size_t size, size_t alignment) {
+    assert(size > 0 && (alignment & (alignment - 1)) == 0);
+    if (alignment <= fz__MALLOC_ALIGNMENT) return fz_platform_realloc(ptr, size);
+
+#if defined(fz_OS_WINDOWS)
+    void *result = _aligned_realloc(ptr, size, alignment);
+    assert(result && "Failed to reallocate aligned memory.");
+    return result;
+#else
+    // realloc keeps malloc's alignment only; most of the time that's enough by luck.
+    void *result = realloc(ptr, size);
+    assert(result && "Failed to reallocate aligned memory.");
+    if (((uintptr_t)result & (alignment - 1)) == 0) return result;
+
+    void *aligned = fz_platform_alloc_aligned(size, alignment);
+    memcpy(aligned, result, old_size < size ? old_size : size);
+    free(result);
+    return aligned;
+#endif
+}
+
+// mmap and friends: the virtual memory below, and file mapping further down.
+#if defined(fz_OS_UNIX)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+size_t fz_platform_page_size(void) {
+#if defined(fz_OS_UNIX)
+    return (size_t)sysconf(_SC_PAGESIZE);
+#elif defined(fz_WIN_H_INCLUDED)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (size_t)info.dwPageSize;
+#else
+    return 4096;
+#endif
+}
+
+// with huge pages the range starts on a huge page boundary, so every commit
+// step of fz_HUGE_PAGE_SIZE can be backed by one.
+void *fz_platform_reserve(size_t size, uint32_t pages) {
+#if defined(fz_OS_UNIX)
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_NORESERVE)
+    flags |= MAP_NORESERVE;
+#endif
+
+    size_t slack = pages ? fz_HUGE_PAGE_SIZE : 0;
+    uint8_t *base = (uint8_t *)mmap(NULL, size + slack, PROT_NONE, flags, -1, 0);
+    if (base == (uint8_t *)MAP_FAILED) return NULL;
+    if (!slack) return base;
+
+    uint8_t *aligned = (uint8_t *)fz_align_to_power_of_two((uintptr_t)base, fz_HUGE_PAGE_SIZE);
+    size_t   head    = aligned - base;
+    if (head)         munmap(base, head);
+    if (slack - head) munmap(aligned + size, slack - head);
+    return aligned;
+
+#elif defined(fz_WIN_H_INCLUDED)
+    // large pages on windows can't be committed piecemeal; plain pages it is.
+    fz_UNUSED(pages);
+    return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+
+#else
+    // no virtual memory to speak of: everything is committed up front.
+    fz_UNUSED(pages);
+    return malloc(size);
+#endif
+}
+
+//! @return 0 if the pages couldn't be committed.
+int fz_platform_commit(void *ptr, size_t size, uint32_t pages) {
+#if defined(fz_OS_UNIX)
+#if defined(MAP_HUGETLB)
+    // mapping over the reserved range takes the pages from the huge page pool right away,
+    // so running out is an error here instead of a SIGBUS on first touch.
+    if (pages & fz_PAGES_EXPLICIT_HUGE) {
+        void *huge = mmap(ptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0);
+        if (huge != MAP_FAILED) return 1;
+
+        // a failed MAP_FIXED may have taken the reservation down with it; put it back.
+        fz_platform_decommit(ptr, size);
+    }
+#endif
+
+    if (mprotect(ptr, size, PROT_READ | PROT_WRITE) != 0) return 0;
+#if defined(MADV_HUGEPAGE)
+    if (pages) madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    return 1;
 
-void *fz_platform_alloc(size_t size) {
-    assert(size > 0);
-    void *result = malloc(size);
+#elif defined(fz_WIN_H_INCLUDED)
+    fz_UNUSED(pages);
+    return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
 
-    assert(result && "Failed to allocate memory.");
-    return result;
+#else
+    fz_UNUSED(ptr);
+    fz_UNUSED(size);
+    fz_UNUSED(pages);
+    return 1;
+#endif
 }
 
-void *fz_platform_realloc(void *ptr, size_t size) {
-    assert(size > 0);
-    void *result = realloc(ptr, size);
+// the pages go back to the OS; the range stays reserved.
+void fz_platform_decommit(void *ptr, size_t size) {
+#if defined(fz_OS_UNIX)
+    // a fresh PROT_NONE mapping drops plain and huge pages alike.
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+#if defined(MAP_NORESERVE)
+    flags |= MAP_NORESERVE;
+#endif
+    mmap(ptr, size, PROT_NONE, flags, -1, 0);
 
-    assert(result && "Failed to reallocate memory.");
-    return result;
+#elif defined(fz_WIN_H_INCLUDED)
+    VirtualFree(ptr, size, MEM_DECOMMIT);
+
+#else
+    fz_UNUSED(ptr);
+    fz_UNUSED(size);
+#endif
 }
 
-void fz_platform_free(void *ptr) {
-    assert(ptr && "trying to free a pointer that is null.");
+void fz_platform_release(void *ptr, size_t size) {
+#if defined(fz_OS_UNIX)
+    munmap(ptr, size);
+#elif defined(fz_WIN_H_INCLUDED)
+    fz_UNUSED(size);
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    fz_UNUSED(size);
     free(ptr);
+#endif
 }
 
 fz_OPER_FUNC(fz_heap_operation) {
+    fz_UNUSED(user_data);
     switch(op) {
         case fz_MEMORY_OPER_ALLOCATE:
-            return fz_platform_alloc(size);
+            return fz_platform_alloc_aligned(size, alignment);
 
         case fz_MEMORY_OPER_FREE:
             fz_platform_free(ptr); return NULL;
 
         case fz_MEMORY_OPER_REALLOCATE:
-            return fz_platform_realloc(ptr, size);
+            return fz_platform_realloc_aligned(ptr, old_size, size, alignment);
     }
     return NULL;
 }
@@ -605,8 +2318,8 @@ int fz__vec_grow(void **output, fz_Array_Header_Type *header, size_t element_siz
     int next_length = header->used + grow_count;
 
     while(next_cap <= next_length) next_cap *= 2;
-    size_t old_size = (size_t) header->caps * element_size;
-    size_t new_size = (size_t) next_cap     * element_size;
+    size_t old_size = sizeof(fz_Array_Header_Type) + (size_t) header->caps * element_size;
+    size_t new_size = sizeof(fz_Array_Header_Type) + (size_t) next_cap     * element_size;
 
     fz_Array_Header_Type *new_array = (fz_Array_Header_Type *)fz_realloc_ex(header->allocator, header, old_size, new_size);
     assert(new_array);
@@ -642,26 +2355,79 @@ void fz__vec_sort(fz_Vec(void) array, size_t elem_size, fz_COMPARATOR_FUNC compa
  * ==================================================
  * */
 
-#ifndef fz_PUSH_ALIGNMENT
-#define fz_PUSH_ALIGNMENT 16
-#endif
-
 void fz_arena_init(fz_Arena *arena, void *backing_memory, size_t memory_size) {
     if (arena && backing_memory) {
-        arena->capacity = memory_size;
-        arena->used     = 0;
-        arena->memory   = (uint8_t *)backing_memory;
-        arena->capacity = memory_size;
+        memset(arena, 0, sizeof(*arena));
+        arena->memory    = (uint8_t *)backing_memory;
+        arena->capacity  = memory_size;
+        arena->committed = memory_size;
     }
 }
 
+static size_t fz__arena_commit_step(const fz_Arena *arena) {
+    if (arena->pages) return fz_HUGE_PAGE_SIZE;
+
+    size_t page = fz_platform_page_size();
+    return page > fz_ARENA_COMMIT_STEP ? page : fz_ARENA_COMMIT_STEP;
+}
+
+int fz_arena_init_virtual(fz_Arena *arena, size_t reserve_size, uint32_t pages) {
+    memset(arena, 0, sizeof(*arena));
+    arena->pages      = pages;
+    arena->is_virtual = 1;
+
+    size_t step = fz__arena_commit_step(arena);
+    reserve_size = fz_align_to_power_of_two(reserve_size, step);
+
+    arena->memory = (uint8_t *)fz_platform_reserve(reserve_size, pages);
+    if (!arena->memory) return 0;
+
+    arena->capacity       = reserve_size;
+    arena->keep_committed = fz_align_to_power_of_two(fz_ARENA_KEEP_COMMITTED, step);
+    return 1;
+}
+
+// makes [0, needed) usable; only ever fails for a fixed arena, or out of address space.
+static int fz__arena_ensure(fz_Arena *arena, size_t needed) {
+    if (needed <= arena->committed) return 1;
+
+    assert(arena->is_virtual && "arena is out of memory.");
+    assert(needed <= arena->capacity && "arena is out of address space.");
+    if (!arena->is_virtual || needed > arena->capacity) return 0;
+
+    size_t target = fz_align_to_power_of_two(needed, fz__arena_commit_step(arena));
+    if (target > arena->capacity) target = arena->capacity;
+    if (!fz_platform_commit(arena->memory + arena->committed, target - arena->committed, arena->pages)) return 0;
+
+    arena->committed = target;
+    return 1;
+}
+
+void fz_arena_reset(fz_Arena *arena) {
+    size_t keep = arena->is_virtual ? fz_align_to_power_of_two(arena->high_water, fz__arena_commit_step(arena)) : 0;
+    if (keep < arena->keep_committed) keep = arena->keep_committed;
+
+    arena->used       = 0;
+    arena->high_water = 0;
+    if (!arena->is_virtual || arena->committed <= keep) return;
+
+    fz_platform_decommit(arena->memory + keep, arena->committed - keep);
+    arena->committed = keep;
+}
+
+// a fixed arena's memory belongs to whoever passed it in.
+void fz_arena_release(fz_Arena *arena) {
+    if (arena->is_virtual && arena->memory) fz_platform_release(arena->memory, arena->capacity);
+    memset(arena, 0, sizeof(*arena));
+}
+
 fz_OPER_FUNC(fz_arena_operation) {
     fz_Arena *arena = (fz_Arena *)user_data;
 
     int reallocating = 0;
     switch(op) {
         case fz_MEMORY_OPER_REALLOCATE:
-            assert(arena->memory < ptr && ptr < (arena->memory + arena->capacity));
+            assert(arena->memory <= ptr && ptr < (arena->memory + arena->capacity));
             reallocating = 1;
         /*
          * fallthrough.
@@ -671,36 +2437,42 @@ fz_OPER_FUNC(fz_arena_operation) {
         case fz_MEMORY_OPER_ALLOCATE:
         {
             if (size < fz_PUSH_ALIGNMENT) size = fz_PUSH_ALIGNMENT;
+            if (alignment == 0) alignment = fz_PUSH_ALIGNMENT;
 
             if (reallocating) {
                 assert(old_size <= arena->used);
 
-                if (ptr == (arena->memory + (arena->used - old_size))) { // ptr is the last allocation point and can be simply extended.
+                // ptr is the last allocation point and can be simply extended, if it's aligned enough.
+                if (ptr == (arena->memory + (arena->used - old_size)) && ((uintptr_t)ptr & (alignment - 1)) == 0) {
                     // NOTE(fuzzy): I don't know why you would want to do that, but you can realloc memory to a smaller size.
                     // in that case do nothing.
                     if (old_size < size) {
                         size_t size_difference = size - old_size;
                         uintptr_t aligned_size = fz_align_to_power_of_two(size_difference, fz_PUSH_ALIGNMENT);
+                        if (!fz__arena_ensure(arena, arena->used + aligned_size)) return NULL;
+
                         arena->used += aligned_size;
+                        if (arena->used > arena->high_water) arena->high_water = arena->used;
                     }
                     return ptr;
                 }
             }
 
             uintptr_t unaligned_memory_ptr = (uintptr_t)(arena->memory + arena->used);
-            uintptr_t memory_ptr = fz_align_to_power_of_two(unaligned_memory_ptr, fz_PUSH_ALIGNMENT);
+            uintptr_t memory_ptr = fz_align_to_power_of_two(unaligned_memory_ptr, alignment);
 
             // This amount (remainder) will be pushed along with the size of allocation
             // to match the alignment. this will never go negative.
             ptrdiff_t remainder = memory_ptr - unaligned_memory_ptr;
             assert(remainder >= 0);
-            assert((arena->used + remainder + size) < arena->capacity);
+            if (!fz__arena_ensure(arena, arena->used + remainder + size)) return NULL;
 
             uint8_t *memory = (uint8_t *)memory_ptr;
             arena->used += remainder + size;
+            if (arena->used > arena->high_water) arena->high_water = arena->used;
 
             if (reallocating) {
-                memmove(ptr, memory, old_size);
+                memmove(memory, ptr, old_size);
             }
 
             return memory;
@@ -759,13 +2531,18 @@ fz_OPER_FUNC(fz_stack_operation) {
     switch(op) {
         case fz_MEMORY_OPER_ALLOCATE:
         {
+            if (alignment < fz_PUSH_ALIGNMENT) alignment = fz_PUSH_ALIGNMENT;
+
+            // the header sits right before the user pointer, so align the pointer
+            // and let the padding take whatever is in front of the header.
             size_t new_size = size + sizeof(fz_Stack_Header);
             uintptr_t unaligned_ptr = (uintptr_t)(stack->base + stack->current);
-            uintptr_t memory_ptr = fz_align_to_power_of_two(unaligned_ptr, fz_PUSH_ALIGNMENT);
+            uintptr_t user_ptr = fz_align_to_power_of_two(unaligned_ptr + sizeof(fz_Stack_Header), alignment);
+            uintptr_t memory_ptr = user_ptr - sizeof(fz_Stack_Header);
 
             ptrdiff_t remainder = memory_ptr - unaligned_ptr;
             assert(remainder >= 0);
-            assert((stack->current + remainder + new_size) < stack->caps);
+            assert((stack->current + remainder + new_size) <= stack->caps);
 
             fz_Stack_Header *memory = (fz_Stack_Header *)memory_ptr;
 
@@ -774,7 +2551,6 @@ fz_OPER_FUNC(fz_stack_operation) {
 
             stack->prev     = stack->current;
             stack->current += new_size + remainder;
-            stack->caps    += new_size + remainder;
 
             return (void *)(memory + 1);
         } break;
@@ -788,7 +2564,6 @@ fz_OPER_FUNC(fz_stack_operation) {
 
             stack->current = stack->prev;
             stack->prev = header->prev_offset;
-            stack->caps -= stack->current - stack->prev;
         } break;
 
         case fz_MEMORY_OPER_REALLOCATE:
@@ -798,10 +2573,12 @@ fz_OPER_FUNC(fz_stack_operation) {
             size_t header_placed_in = ((size_t)header - header->padding - (size_t)stack->base);
             assert(stack->prev == header_placed_in && "Order difference: stack free must follow LIFO rules.");
 
-            size_t allocation_size = stack->prev - stack->current;
-            if (allocation_size < size) {
-                stack->current += size - allocation_size;
-            }
+            assert(((uintptr_t)ptr & (alignment - 1)) == 0 && "stack can't move an allocation to a bigger alignment.");
+
+            // it's the top allocation, so it simply ends somewhere else now.
+            size_t end = ((uint8_t *)ptr - stack->base) + size;
+            assert(end <= stack->caps);
+            stack->current = end;
 
             return ptr;
         } break;
@@ -817,27 +2594,37 @@ fz_OPER_FUNC(fz_stack_operation) {
  * */
 
 void fz_pool_init(fz_Pool *pool, void *backing_memory, size_t memory_size, size_t element_size) {
+    fz_pool_init_aligned(pool, backing_memory, memory_size, element_size, fz_PUSH_ALIGNMENT);
+}
+
+void fz_pool_init_aligned(fz_Pool *pool, void *backing_memory, size_t memory_size, size_t element_size, size_t alignment) {
     assert(memory_size  > sizeof(fz_SLL_Header));
     assert(element_size > sizeof(fz_SLL_Header));
+    if (alignment < sizeof(void *)) alignment = sizeof(void *); // room for the sll header.
 
-    uint8_t *backing = (uint8_t *)backing_memory;
-    size_t available_count = memory_size / element_size; // any fractions will get rounded down to 0.
-    memset(backing, 0, memory_size);
+    uint8_t *backing = (uint8_t *)fz_align_to_power_of_two((uintptr_t)backing_memory, alignment);
+    size_t skipped = backing - (uint8_t *)backing_memory;
+    assert(skipped < memory_size);
+    memory_size -= skipped;
 
-    // NOTE:
-    // available_count - 1 means that the last one of the sll header
-    // will be left resetted to zero from the memset above;
-    // effectively leaving the next member variable to NULL
-    for (int i = 0; i < available_count - 1; ++i) {
-        size_t memory_position = i * element_size;
-        fz_SLL_Header *current = (fz_SLL_Header *)(backing + memory_position);
-        current->next = (fz_SLL_Header *)(backing + memory_position + element_size);
-    }
+    size_t stride = fz_align_to_power_of_two(element_size, alignment);
+    size_t available_count = memory_size / stride; // any fractions will get rounded down to 0.
+    assert(available_count > 0);
 
     pool->base         = backing;
     pool->element_size = element_size;
+    pool->stride       = stride;
+    pool->alignment    = alignment;
     pool->memory_caps  = memory_size;
-    pool->free         = (fz_SLL_Header *)backing;
+    pool->capacity     = available_count;
+    pool->bumped       = 0;
+    pool->zero_memory  = 1;
+    pool->free         = NULL;
+}
+
+void fz_pool_reset(fz_Pool *pool) {
+    pool->bumped = 0;
+    pool->free   = NULL;
 }
 
 fz_Allocator fz_pool_allocator(fz_Pool *pool) {
@@ -856,19 +2643,27 @@ fz_OPER_FUNC(fz_pool_operation) {
         case fz_MEMORY_OPER_ALLOCATE:
         {
             assert(size == pool->element_size);
-            fz_SLL_Header *available_chunk = pool->free;
+            assert(alignment <= pool->alignment && "pool elements are less aligned than asked; use fz_pool_init_aligned.");
+            void *result;
 
-            if (pool->free)
+            if (pool->free) { // recycled first, so the resident set only grows when it has to.
+                result = pool->free;
                 pool->free = pool->free->next;
+            } else if (pool->bumped < pool->capacity) {
+                result = pool->base + pool->bumped * pool->stride;
+                pool->bumped += 1;
+            } else {
+                return NULL;
+            }
 
-            memset(available_chunk, 0, size);
-            return (void *)available_chunk;
+            if (pool->zero_memory) memset(result, 0, size);
+            return result;
         };
 
         case fz_MEMORY_OPER_FREE:
         {
-            assert(pool->base <= ptr && ptr < (pool->base + pool->memory_caps));
-            memset(ptr, 0, pool->element_size);
+            assert(pool->base <= ptr && ptr < (pool->base + pool->bumped * pool->stride));
+            assert(((uint8_t *)ptr - pool->base) % pool->stride == 0 && "not an element of this pool.");
 
             fz_SLL_Header freed;
             freed.next = pool->free;
@@ -918,7 +2713,11 @@ fz_Allocator fz_freelist_allocator(fz_Freelist *freelist) {
 
 fz_OPER_FUNC(fz_freelist_operation) {
     fz_Freelist *list = (fz_Freelist *)user_data;
-    size_t size_pow2 = fz_align_to_power_of_two(size, 16);
+
+    // blocks start 16 aligned, so bigger alignments need room to slide the pointer forward.
+    if (alignment < fz_PUSH_ALIGNMENT) alignment = fz_PUSH_ALIGNMENT;
+    size_t slack = alignment - fz_PUSH_ALIGNMENT;
+    size_t size_pow2 = fz_align_to_power_of_two(size + slack, 16);
 
     switch(op) {
         case fz_MEMORY_OPER_ALLOCATE:
@@ -961,14 +2760,17 @@ fz_OPER_FUNC(fz_freelist_operation) {
 
             fz_SizeHeader *header = (fz_SizeHeader *)best_fit;
             header->size = best_fit->size;
-            return (void *)(header + 1);
+
+            uintptr_t memory_ptr = fz_align_to_power_of_two((uintptr_t)(header + 1), alignment);
+            ((size_t *)memory_ptr)[-1] = memory_ptr - (uintptr_t)header;
+            return (void *)memory_ptr;
         } break;
 
         case fz_MEMORY_OPER_FREE:
         {
             assert(list->base <= ptr && ptr < ((char *)list->base + list->memory_caps));
 
-            fz_SizeHeader *header = ((fz_SizeHeader*)ptr - 1);
+            fz_SizeHeader *header = (fz_SizeHeader *)((char *)ptr - ((size_t *)ptr)[-1]);
             size_t block_size = header->size;
 
             // Coalesce
@@ -976,7 +2778,7 @@ fz_OPER_FUNC(fz_freelist_operation) {
             fz_ListNode *coalesce = NULL;
 
             while(node != &list->sentinel) {
-                if (node == (fz_ListNode *)((char *)ptr + block_size)) {
+                if (node == (fz_ListNode *)((char *)(header + 1) + block_size)) {
                     coalesce = node;
                     break;
                 }
@@ -1000,14 +2802,18 @@ fz_OPER_FUNC(fz_freelist_operation) {
 
         case fz_MEMORY_OPER_REALLOCATE:
         {
-            size_t block_size = ((fz_SizeHeader*)ptr - 1)->size;
-            assert(size > block_size);
+            size_t offset = ((size_t *)ptr)[-1];
+            fz_SizeHeader *header = (fz_SizeHeader *)((char *)ptr - offset);
+            size_t usable = header->size - (offset - sizeof(fz_SizeHeader));
+
+            // still fits where it is.
+            if (size <= usable && ((uintptr_t)ptr & (alignment - 1)) == 0) return ptr;
 
-            void *new_memory = fz_freelist_operation(fz_MEMORY_OPER_ALLOCATE, 0, 0, size, user_data);
+            void *new_memory = fz_freelist_operation(fz_MEMORY_OPER_ALLOCATE, 0, 0, size, alignment, user_data);
 
             if (new_memory) {
-                memmove(new_memory, ptr, block_size);
-                fz_freelist_operation(fz_MEMORY_OPER_FREE, ptr, 0, 0, user_data);
+                memmove(new_memory, ptr, old_size < usable ? old_size : usable);
+                fz_freelist_operation(fz_MEMORY_OPER_FREE, ptr, 0, 0, 0, user_data);
                 return new_memory;
             }
 
@@ -1018,6 +2824,205 @@ fz_OPER_FUNC(fz_freelist_operation) {
     return NULL;
 }
 
+/*
+ * ==================================================
+ * Allocator Instrumentation.
+ * ==================================================
+ * */
+
+#if defined(fz_ALLOC_STATS)
+
+fz_THREAD_LOCAL const char *fz__alloc_site = 0;
+
+static size_t fz__alloc_hash(void *ptr) {
+    uint64_t h = (uint64_t)(uintptr_t)ptr;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (size_t)h;
+}
+
+static void fz__alloc_table_put(fz_Alloc_Stats *stats, void *ptr, size_t size, const char *site);
+
+static void fz__alloc_table_grow(fz_Alloc_Stats *stats) {
+    fz_Alloc_Entry *old      = stats->entries;
+    size_t          old_caps = stats->entry_caps;
+
+    stats->entry_caps = old_caps ? old_caps * 2 : 1024;
+    stats->entries    = (fz_Alloc_Entry *)fz_platform_alloc(sizeof(fz_Alloc_Entry) * stats->entry_caps);
+    memset(stats->entries, 0, sizeof(fz_Alloc_Entry) * stats->entry_caps);
+
+    for (size_t i = 0; i < old_caps; ++i) {
+        if (old[i].ptr) fz__alloc_table_put(stats, old[i].ptr, old[i].size, old[i].site);
+    }
+    if (old) fz_platform_free(old);
+}
+
+static void fz__alloc_table_put(fz_Alloc_Stats *stats, void *ptr, size_t size, const char *site) {
+    if ((stats->live_count + 1) * 2 > stats->entry_caps) fz__alloc_table_grow(stats);
+
+    size_t mask = stats->entry_caps - 1;
+    size_t i    = fz__alloc_hash(ptr) & mask;
+    while (stats->entries[i].ptr) i = (i + 1) & mask;
+
+    stats->entries[i].ptr  = ptr;
+    stats->entries[i].size = size;
+    stats->entries[i].site = site;
+}
+
+// removes ptr and returns its entry. backward-shift deletion, so no tombstones.
+static fz_Alloc_Entry fz__alloc_table_take(fz_Alloc_Stats *stats, void *ptr) {
+    fz_Alloc_Entry result = {0};
+    if (!stats->entry_caps) return result;
+
+    size_t mask = stats->entry_caps - 1;
+    size_t i    = fz__alloc_hash(ptr) & mask;
+    while (stats->entries[i].ptr && stats->entries[i].ptr != ptr) i = (i + 1) & mask;
+    if (!stats->entries[i].ptr) return result;
+
+    result = stats->entries[i];
+    stats->entries[i].ptr = NULL;
+
+    size_t hole = i;
+    for (size_t j = (i + 1) & mask; stats->entries[j].ptr; j = (j + 1) & mask) {
+        size_t home = fz__alloc_hash(stats->entries[j].ptr) & mask;
+        // can entries[j] move back into the hole without passing its home slot?
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            stats->entries[hole] = stats->entries[j];
+            stats->entries[j].ptr = NULL;
+            hole = j;
+        }
+    }
+    return result;
+}
+
+static fz_Alloc_Site *fz__alloc_find_site(fz_Alloc_Stats *stats, const char *site) {
+    if (!site) site = "(unknown)";
+    for (int i = 0; i < stats->site_count; ++i) {
+        if (stats->sites[i].site == site || strcmp(stats->sites[i].site, site) == 0) {
+            return &stats->sites[i];
+        }
+    }
+
+    if (stats->site_count == fz_ALLOC_MAX_SITES) {
+        // out of slots: everything else goes to its own bucket, real sites keep their numbers.
+        stats->other_sites.site = "(other sites)";
+        return &stats->other_sites;
+    }
+
+    fz_Alloc_Site *result = &stats->sites[stats->site_count++];
+    memset(result, 0, sizeof(*result));
+    result->site = site;
+    return result;
+}
+
+static void fz__alloc_record(fz_Alloc_Stats *stats, void *ptr, size_t size, const char *site) {
+    int bucket = 0;
+    while (bucket < fz_ALLOC_HISTOGRAM_BUCKETS - 1 && ((size_t)1 << bucket) < size) bucket += 1;
+    stats->histogram[bucket] += 1;
+
+    stats->live_bytes  += size;
+    stats->total_bytes += size;
+    if (stats->live_bytes > stats->peak_bytes) stats->peak_bytes = stats->live_bytes;
+
+    fz_Alloc_Site *s = fz__alloc_find_site(stats, site);
+    s->count      += 1;
+    s->bytes      += size;
+    s->live_bytes += size;
+
+    fz__alloc_table_put(stats, ptr, size, s->site);
+    stats->live_count += 1;
+}
+
+static void fz__alloc_forget(fz_Alloc_Stats *stats, void *ptr) {
+    fz_Alloc_Entry entry = fz__alloc_table_take(stats, ptr);
+    if (!entry.ptr) return; // allocated before the hook went in.
+
+    stats->live_bytes -= entry.size;
+    stats->live_count -= 1;
+    fz__alloc_find_site(stats, entry.site)->live_bytes -= entry.size;
+}
+
+fz_OPER_FUNC(fz_tracked_operation) {
+    fz_Alloc_Stats *stats = (fz_Alloc_Stats *)user_data;
+    const char *site = fz__alloc_site;
+    fz__alloc_site = NULL;
+
+    void *result = stats->inner.oper_func(op, ptr, old_size, size, alignment, stats->inner.user_data);
+
+    switch(op) {
+        case fz_MEMORY_OPER_ALLOCATE:
+        {
+            stats->alloc_count += 1;
+            if (result) fz__alloc_record(stats, result, size, site);
+        } break;
+
+        case fz_MEMORY_OPER_FREE:
+        {
+            stats->free_count += 1;
+            fz__alloc_forget(stats, ptr);
+        } break;
+
+        case fz_MEMORY_OPER_REALLOCATE:
+        {
+            stats->realloc_count += 1;
+            if (result) {
+                fz__alloc_forget(stats, ptr);
+                fz__alloc_record(stats, result, size, site);
+            }
+        } break;
+    }
+
+    return result;
+}
+
+fz_Allocator fz_tracked_allocator(fz_Alloc_Stats *stats, const char *name, fz_Allocator inner) {
+    memset(stats, 0, sizeof(*stats));
+    stats->name  = name;
+    stats->inner = inner;
+
+    fz_Allocator result;
+    result.user_data = stats;
+    result.oper_func = fz_tracked_operation;
+    return result;
+}
+
+void fz_alloc_stats_report(fz_Alloc_Stats *stats, FILE *out) {
+    fprintf(out, "[alloc] ===== %s =====\n", stats->name ? stats->name : "(unnamed)");
+    fprintf(out, "[alloc] live: %zu bytes in %zu blocks, peak: %zu bytes, total: %zu bytes\n",
+            stats->live_bytes, stats->live_count, stats->peak_bytes, stats->total_bytes);
+    fprintf(out, "[alloc] calls: %zu alloc, %zu realloc, %zu free\n",
+            stats->alloc_count, stats->realloc_count, stats->free_count);
+
+    for (int i = 0; i < fz_ALLOC_HISTOGRAM_BUCKETS; ++i) {
+        if (stats->histogram[i]) {
+            fprintf(out, "[alloc]   <= %10zu bytes: %zu\n", (size_t)1 << i, stats->histogram[i]);
+        }
+    }
+
+    for (int i = 0; i < stats->site_count; ++i) {
+        fz_Alloc_Site *s = &stats->sites[i];
+        fprintf(out, "[alloc]   %s: %zu calls, %zu bytes, %zu live\n", s->site, s->count, s->bytes, s->live_bytes);
+    }
+    if (stats->other_sites.count) {
+        fz_Alloc_Site *s = &stats->other_sites;
+        fprintf(out, "[alloc]   %s: %zu calls, %zu bytes, %zu live\n", s->site, s->count, s->bytes, s->live_bytes);
+    }
+
+    for (size_t i = 0; i < stats->entry_caps; ++i) {
+        fz_Alloc_Entry *e = &stats->entries[i];
+        if (e->ptr) fprintf(out, "[alloc] LEAK: %zu bytes at %p from %s\n", e->size, e->ptr, e->site);
+    }
+}
+
+void fz_alloc_stats_release(fz_Alloc_Stats *stats) {
+    if (stats->entries) fz_platform_free(stats->entries);
+    stats->entries    = NULL;
+    stats->entry_caps = 0;
+}
+
+#endif // fz_ALLOC_STATS
+
 #else  // if !defined(fz_MINIMAL_FOOTPRINT) {...above block...} else
 
 // xmalloc, xrealloc, xcalloc never returns 0.
@@ -1054,6 +3059,419 @@ void *xcalloc(size_t size, size_t count) {
 
 #endif // fz_MINIMAL_FOOTPRINT
 
+/*
+ * ==================================================
+ * Delta compression.
+ * ==================================================
+ * */
+
+struct fz__Delta_Run {
+    uint32_t skip;
+    uint32_t count;
+};
+
+// the last word can be partial; only the bytes inside the block are touched.
+static uint64_t fz__delta_load(const void *block, size_t size, size_t word) {
+    uint64_t result = 0;
+    size_t offset = word * 8;
+    memcpy(&result, (const uint8_t *)block + offset, (size - offset) < 8 ? (size - offset) : 8);
+    return result;
+}
+
+static void fz__delta_store(void *block, size_t size, size_t word, uint64_t value) {
+    size_t offset = word * 8;
+    memcpy((uint8_t *)block + offset, &value, (size - offset) < 8 ? (size - offset) : 8);
+}
+
+size_t fz_delta_bound(size_t size) {
+    size_t words = (size + 7) / 8;
+    return sizeof(fz__Delta_Run) + words * 8;
+}
+
+size_t fz_delta_capture(void *prev, const void *curr, size_t size, void *out, size_t out_caps) {
+    size_t words = (size + 7) / 8;
+    uint8_t *cursor = (uint8_t *)out;
+    uint8_t *end    = cursor + out_caps;
+
+    size_t word = 0;
+    size_t last = 0; // first word after the previous run.
+    while (word < words) {
+        uint64_t a = fz__delta_load(prev, size, word);
+        uint64_t b = fz__delta_load(curr, size, word);
+        if (a == b) { word += 1; continue; }
+
+        fz__Delta_Run run;
+        run.skip  = (uint32_t)(word - last);
+        run.count = 0;
+
+        assert(cursor + sizeof(run) <= end && "fz_delta_capture: out of space.");
+        uint8_t *run_at = cursor;
+        cursor += sizeof(run);
+
+        // keep going while words differ. a single equal word in between is cheaper
+        // to carry as a literal 0 than to start a new run for.
+        while (word < words) {
+            a = fz__delta_load(prev, size, word);
+            b = fz__delta_load(curr, size, word);
+            if (a == b && (word + 1 >= words || fz__delta_load(prev, size, word + 1) == fz__delta_load(curr, size, word + 1))) {
+                break;
+            }
+
+            uint64_t x = a ^ b;
+            assert(cursor + 8 <= end && "fz_delta_capture: out of space.");
+            memcpy(cursor, &x, 8);
+            cursor += 8;
+
+            if (x) fz__delta_store(prev, size, word, b);
+            run.count += 1;
+            word      += 1;
+        }
+
+        memcpy(run_at, &run, sizeof(run));
+        last = word;
+    }
+
+    fz_UNUSED(end);
+    return (size_t)(cursor - (uint8_t *)out);
+}
+
+void fz_delta_apply(void *block, size_t size, const void *delta, size_t delta_size) {
+    const uint8_t *cursor = (const uint8_t *)delta;
+    const uint8_t *end    = cursor + delta_size;
+
+    size_t word = 0;
+    while (cursor < end) {
+        fz__Delta_Run run;
+        memcpy(&run, cursor, sizeof(run));
+        cursor += sizeof(run);
+        word   += run.skip;
+
+        for (uint32_t i = 0; i < run.count; ++i, ++word) {
+            uint64_t x;
+            memcpy(&x, cursor, 8);
+            cursor += 8;
+            fz__delta_store(block, size, word, fz__delta_load(block, size, word) ^ x);
+        }
+    }
+}
+
+/*
+ * ==================================================
+ * File Mapping.
+ * ==================================================
+ * */
+
+static fz_File_Map fz__file_read_all(const char *path) {
+    fz_File_Map result = {0};
+    FILE *file = fopen(path, "rb");
+    if (!file) return result;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (size > 0) {
+        result.data = malloc((size_t)size);
+        if (result.data) result.size = fread(result.data, 1, (size_t)size, file);
+    }
+    fclose(file);
+    return result;
+}
+
+fz_File_Map fz_file_map(const char *path) {
+#if defined(fz_OS_UNIX)
+    fz_File_Map result = {0};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return result;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            result.data   = data;
+            result.size   = (size_t)st.st_size;
+            result.mapped = 1;
+        }
+    }
+    close(fd);
+
+    if (!result.mapped) return fz__file_read_all(path);
+    return result;
+
+#elif defined(fz_WIN_H_INCLUDED)
+    fz_File_Map result = {0};
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return result;
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) {
+            result.data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (result.data) {
+                result.size   = (size_t)size.QuadPart;
+                result.mapped = true;
+                result.handle = (intptr_t)mapping;
+            } else {
+                CloseHandle(mapping);
+            }
+        }
+    }
+    CloseHandle(file);
+
+    if (!result.mapped) return fz__file_read_all(path);
+    return result;
+
+#else
+    return fz__file_read_all(path);
+#endif
+}
+
+void fz_file_unmap(fz_File_Map *map) {
+    if (!map->data) return;
+
+    if (map->mapped) {
+#if defined(fz_OS_UNIX)
+        munmap(map->data, map->size);
+#elif defined(fz_WIN_H_INCLUDED)
+        UnmapViewOfFile(map->data);
+        CloseHandle((HANDLE)map->handle);
+#endif
+    } else {
+        free(map->data);
+    }
+
+    map->data = NULL;
+    map->size = 0;
+}
+
+// random and fixed point batch kernels.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define fz_SSE2 1
+#endif
+
+// ==================================================
+// Random.
+
+static uint64_t fz__splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void fz_rng_seed(fz_Rng *rng, uint64_t seed) {
+    // splitmix64 never gives four zeros, which is the one state xoshiro can't leave.
+    for (int i = 0; i < 4; ++i) rng->s[i] = fz__splitmix64(&seed);
+}
+
+static void fz__rng_jump_by(fz_Rng *rng, const uint64_t table[4]) {
+    uint64_t s[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 4; ++i) {
+        for (int b = 0; b < 64; ++b) {
+            if (table[i] & ((uint64_t)1 << b)) {
+                s[0] ^= rng->s[0];
+                s[1] ^= rng->s[1];
+                s[2] ^= rng->s[2];
+                s[3] ^= rng->s[3];
+            }
+            fz_rng_next(rng);
+        }
+    }
+    memcpy(rng->s, s, sizeof(s));
+}
+
+void fz_rng_jump(fz_Rng *rng) {
+    static const uint64_t table[4] = { 0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull, 0xA9582618E03FC9AAull, 0x39ABDC4529B1661Cull };
+    fz__rng_jump_by(rng, table);
+}
+
+void fz_rng_long_jump(fz_Rng *rng) {
+    static const uint64_t table[4] = { 0x76E15D3EFEFDCBBFull, 0xC5004E441C522FB3ull, 0x77710069854EE241ull, 0x39109BB02ACBE635ull };
+    fz__rng_jump_by(rng, table);
+}
+
+fz_Rng fz_rng_split(fz_Rng *rng) {
+    fz_Rng result = *rng;
+    fz_rng_jump(rng);
+    return result;
+}
+
+void fz_pcg32_seed(fz_Pcg32 *rng, uint64_t seed, uint64_t stream) {
+    rng->state = 0;
+    rng->inc   = (stream << 1) | 1;
+    fz_pcg32_next(rng);
+    rng->state += seed;
+    fz_pcg32_next(rng);
+}
+
+void fz_pcg32_advance(fz_Pcg32 *rng, uint64_t delta) {
+    uint64_t cur_mult = 6364136223846793005ull;
+    uint64_t cur_plus = rng->inc;
+    uint64_t acc_mult = 1;
+    uint64_t acc_plus = 0;
+
+    while (delta > 0) {
+        if (delta & 1) {
+            acc_mult *= cur_mult;
+            acc_plus  = acc_plus * cur_mult + cur_plus;
+        }
+        cur_plus  = (cur_mult + 1) * cur_plus;
+        cur_mult *= cur_mult;
+        delta >>= 1;
+    }
+    rng->state = acc_mult * rng->state + acc_plus;
+}
+
+void fz_rng_wide_seed(fz_Rng_Wide *wide, fz_Rng *from) {
+    for (int lane = 0; lane < fz_RNG_LANES; ++lane) {
+        fz_Rng stream = fz_rng_split(from);
+        for (int w = 0; w < 4; ++w) wide->s[w][lane] = stream.s[w];
+    }
+}
+
+// blocks of 2 * fz_RNG_LANES values.
+static void fz__rng_wide_generate(fz_Rng_Wide *wide, uint32_t *out, size_t blocks) {
+#if defined(fz_SSE2)
+#define fz__ROTL64X2(x, k) _mm_or_si128(_mm_slli_epi64((x), (k)), _mm_srli_epi64((x), 64 - (k)))
+    for (int half = 0; half < fz_RNG_LANES; half += 2) {
+        __m128i s0 = _mm_loadu_si128((const __m128i *)&wide->s[0][half]);
+        __m128i s1 = _mm_loadu_si128((const __m128i *)&wide->s[1][half]);
+        __m128i s2 = _mm_loadu_si128((const __m128i *)&wide->s[2][half]);
+        __m128i s3 = _mm_loadu_si128((const __m128i *)&wide->s[3][half]);
+
+        for (size_t b = 0; b < blocks; ++b) {
+            // no 64-bit multiply in SSE2: *5 and *9 as shift + add.
+            __m128i x5 = _mm_add_epi64(_mm_slli_epi64(s1, 2), s1);
+            __m128i r  = fz__ROTL64X2(x5, 7);
+            __m128i result = _mm_add_epi64(_mm_slli_epi64(r, 3), r);
+            __m128i t  = _mm_slli_epi64(s1, 17);
+
+            s2 = _mm_xor_si128(s2, s0);
+            s3 = _mm_xor_si128(s3, s1);
+            s1 = _mm_xor_si128(s1, s2);
+            s0 = _mm_xor_si128(s0, s3);
+            s2 = _mm_xor_si128(s2, t);
+            s3 = fz__ROTL64X2(s3, 45);
+
+            _mm_storeu_si128((__m128i *)(out + b * 2 * fz_RNG_LANES + half * 2), result);
+        }
+
+        _mm_storeu_si128((__m128i *)&wide->s[0][half], s0);
+        _mm_storeu_si128((__m128i *)&wide->s[1][half], s1);
+        _mm_storeu_si128((__m128i *)&wide->s[2][half], s2);
+        _mm_storeu_si128((__m128i *)&wide->s[3][half], s3);
+    }
+#undef fz__ROTL64X2
+#else
+    for (size_t b = 0; b < blocks; ++b) {
+        for (int lane = 0; lane < fz_RNG_LANES; ++lane) {
+            fz_Rng rng;
+            for (int w = 0; w < 4; ++w) rng.s[w] = wide->s[w][lane];
+            uint64_t r = fz_rng_next(&rng);
+            for (int w = 0; w < 4; ++w) wide->s[w][lane] = rng.s[w];
+
+            // same order the vector store leaves them in: low half first.
+            out[b * 2 * fz_RNG_LANES + lane * 2 + 0] = (uint32_t)r;
+            out[b * 2 * fz_RNG_LANES + lane * 2 + 1] = (uint32_t)(r >> 32);
+        }
+    }
+#endif
+}
+
+void fz_rng_wide_fill_u32(fz_Rng_Wide *wide, uint32_t *out, size_t count) {
+    const size_t per_block = 2 * fz_RNG_LANES;
+    size_t blocks = count / per_block;
+    fz__rng_wide_generate(wide, out, blocks);
+
+    size_t tail = count - blocks * per_block;
+    if (tail) {
+        uint32_t last[2 * fz_RNG_LANES];
+        fz__rng_wide_generate(wide, last, 1);
+        memcpy(out + blocks * per_block, last, tail * sizeof(uint32_t));
+    }
+}
+
+void fz_rng_wide_fill_f32(fz_Rng_Wide *wide, float *out, size_t count) {
+    uint32_t chunk[64];
+    while (count > 0) {
+        size_t n = count < 64 ? count : 64;
+        fz_rng_wide_fill_u32(wide, chunk, n);
+
+        size_t i = 0;
+#if defined(fz_SSE2)
+        const __m128 scale = _mm_set1_ps(1.0f / 16777216.0f);
+        for (; i + 4 <= n; i += 4) {
+            __m128i bits = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(chunk + i)), 8);
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(bits), scale));
+        }
+#endif
+        for (; i < n; ++i) out[i] = (float)(chunk[i] >> 8) * (1.0f / 16777216.0f);
+
+        out   += n;
+        count -= n;
+    }
+}
+
+// ==================================================
+// Fixed point.
+static uint64_t fz__isqrt64(uint64_t x) {
+    uint64_t root = 0;
+    uint64_t bit  = 1ull << 62;
+    while (bit > x) bit >>= 2;
+
+    while (bit) {
+        if (x >= root + bit) {
+            x    -= root + bit;
+            root  = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+fz_Fixed fz_fixed_sqrt(fz_Fixed a) {
+    assert(a.raw >= 0);
+    return fz_fixed_raw((int32_t)fz__isqrt64((uint64_t)a.raw << fz_FIXED_BITS));
+}
+
+fz_Fixed fz_fixed2_length(fz_Fixed2 a) {
+    // the squares are Q32.32, so their root is already Q16.16.
+    uint64_t x = (uint64_t)((int64_t)a.x.raw * a.x.raw);
+    uint64_t y = (uint64_t)((int64_t)a.y.raw * a.y.raw);
+    uint64_t root = fz__isqrt64(x + y);
+    return fz_fixed_raw(root > INT32_MAX ? INT32_MAX : (int32_t)root);
+}
+
+void fz_fixed2_advance(fz_Fixed2 *pos, const fz_Fixed2 *dir, fz_Fixed scale, size_t count) {
+    size_t i = 0;
+#if defined(fz_SSE2)
+    // SSE2 only multiplies unsigned 32x32 -> 64. the signed product differs
+    // from it by 2^32 * ((d < 0 ? s : 0) + (s < 0 ? d : 0)), which lands in
+    // the bits kept after >> 16 as that sum << 16.
+    const __m128i s     = _mm_set1_epi32(scale.raw);
+    const __m128i s_neg = _mm_srai_epi32(s, 31);
+    for (; i + 2 <= count; i += 2) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(pos + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dir + i));
+
+        __m128i even = _mm_srli_epi64(_mm_mul_epu32(d, s), fz_FIXED_BITS);
+        __m128i odd  = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(d, 32), s), fz_FIXED_BITS);
+        __m128i prod = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(3, 1, 2, 0)),
+                                          _mm_shuffle_epi32(odd,  _MM_SHUFFLE(3, 1, 2, 0)));
+
+        __m128i fix = _mm_add_epi32(_mm_and_si128(_mm_srai_epi32(d, 31), s), _mm_and_si128(s_neg, d));
+        prod = _mm_sub_epi32(prod, _mm_slli_epi32(fix, fz_FIXED_BITS));
+
+        _mm_storeu_si128((__m128i *)(pos + i), _mm_add_epi32(p, prod));
+    }
+#endif
+    for (; i < count; ++i) pos[i] = fz_fixed2_add(pos[i], fz_fixed2_scale(dir[i], scale));
+}
+
 #if defined(__cplusplus)
 }
 #endif